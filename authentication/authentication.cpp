@@ -1,4 +1,3 @@
-#include <iostream>
 #include <string>
 #include <cstring>
 //for GenerateDeviceToken
@@ -11,6 +10,7 @@
 #include "sha1.h"
 #include <cstdint>
 #include "authentication.h"
+#include "logger.h"
 
 using namespace std;
 
@@ -55,7 +55,7 @@ string RobinhoodAuthentication::generateDeviceToken() {
 			id += "-";
 		}
 	}
-	cout << "generateDeviceToken(): id=" << id << endl;
+	RH_LOG(LOG_DEBUG, "generateDeviceToken(): id={}", id);
 	return id;
 }
 
@@ -104,6 +104,6 @@ int RobinhoodAuthentication::generateMFACode(const char *key, int step_size) {
 	truncatedHash &= 0x7FFFFFFF;
 	truncatedHash %= VERIFICATION_CODE_MODULUS;
 
-	cout << "generateMFACode(): 2fa code:" << truncatedHash << endl;
+	RH_LOG(LOG_DEBUG, "generateMFACode(): 2fa code:{}", truncatedHash);
 	return truncatedHash;
 }
@@ -0,0 +1,180 @@
+/* robinhood_bench.cpp: microbenchmarks for the request, parse & authentication paths plus
+   end-to-end request latency against the loopback MockServer.
+
+   Usage: robinhood_bench [filter]   runs the benchmarks whose name contains filter;
+          the end-to-end ones only run without a filter or with one starting "e2e".
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "robinhoodtrader.h"
+#include "recordparser.h"
+#include "mockserver.h"
+#include "logger.h"
+#include "authentication/authentication.h"
+
+using namespace std;
+
+//Allocation counting: every operator new in the process goes through these.
+static atomic<uint64_t> allocations(0);
+static atomic<uint64_t> allocatedBytes(0);
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	allocatedBytes.fetch_add(size, memory_order_relaxed);
+	if (void *p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static string filter;
+
+/* run(): Time samples batches of batch calls of op.  Each sample is the mean time per call of
+   its batch, so sub-microsecond operations aren't swamped by the clock.  Allocations are
+   counted process wide, background threads included.
+*/
+template <typename Op>
+static void run(const string &name, size_t samples, size_t batch, Op op) {
+	if (!filter.empty() && name.find(filter) == string::npos)
+		return;
+
+	//Warm caches, connections & lazily built state.
+	for (size_t i = 0; i < std::min<size_t>(samples, 100) * batch / 10 + 1; i++)
+		op();
+
+	vector<double> times;
+	times.reserve(samples);
+	uint64_t allocationsBefore = allocations.load(), bytesBefore = allocatedBytes.load();
+	for (size_t s = 0; s < samples; s++) {
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i < batch; i++)
+			op();
+		auto elapsed = chrono::steady_clock::now() - start;
+		times.push_back(chrono::duration<double, nano>(elapsed).count() / batch);
+	}
+	double calls = double(samples) * batch;
+	double allocationsPerOp = (allocations.load() - allocationsBefore) / calls;
+	double bytesPerOp = (allocatedBytes.load() - bytesBefore) / calls;
+
+	sort(times.begin(), times.end());
+	auto percentile = [&times](double p) { return times[std::min(times.size() - 1, size_t(p * times.size()))]; };
+	double mean = 0;
+	for (double t : times)
+		mean += t;
+	mean /= times.size();
+
+	printf("%-28s %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %8.1f %10.0f\n", name.c_str(), mean,
+			percentile(0.50), percentile(0.90), percentile(0.99), percentile(0.999), times.back(),
+			allocationsPerOp, bytesPerOp);
+}
+
+static const char *quoteBody =
+	"{\"ask_price\":\"26.780000\",\"ask_size\":1200,\"bid_price\":\"26.770000\",\"bid_size\":800,"
+	"\"last_trade_price\":\"26.775000\",\"last_extended_hours_trade_price\":null,"
+	"\"previous_close\":\"26.650000\",\"adjusted_previous_close\":\"26.650000\","
+	"\"previous_close_date\":\"2019-02-28\",\"symbol\":\"XLF\",\"trading_halted\":false,"
+	"\"has_traded\":true,\"last_trade_price_source\":\"consolidated\","
+	"\"updated_at\":\"2019-03-01T20:59:59Z\","
+	"\"instrument\":\"https://api.robinhood.com/instruments/cda4a8c4-8ab7-4aa1-9d87-5bdff2d5d3b1/\"}";
+
+static string batch_body(size_t count) {
+	string body = "{\"results\":[";
+	for (size_t i = 0; i < count; i++) {
+		if (i)
+			body += ",";
+		body += quoteBody;
+	}
+	return body + "]}";
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 1)
+		filter = argv[1];
+
+	printf("%-28s %10s %10s %10s %10s %10s %10s %8s %10s\n", "benchmark (ns/op)", "mean", "p50", "p90",
+			"p99", "p99.9", "max", "allocs", "bytes");
+
+	//Order post bodies
+	OrderTemplate order("https://api.robinhood.com/accounts/5RY82436/",
+						"https://api.robinhood.com/instruments/cda4a8c4-8ab7-4aa1-9d87-5bdff2d5d3b1/",
+						"XLF", BUY, LIMIT, GFD, IMMEDIATE);
+	int64_t tick = 0;
+	run("order_body_build", 10000, 100, [&] {
+		order.build(1 + tick % 100, Price{ 260000 + tick++ % 500 }, Price());
+	});
+	run("order_template_create", 10000, 10, [&] {
+		OrderTemplate fresh("https://api.robinhood.com/accounts/5RY82436/",
+							"https://api.robinhood.com/instruments/cda4a8c4-8ab7-4aa1-9d87-5bdff2d5d3b1/",
+							"XLF", BUY, LIMIT, GFD, IMMEDIATE);
+		fresh.build(1, Price{ 260000 }, Price());
+	});
+
+	//Quote parsing: DOM vs stream
+	size_t quoteLength = strlen(quoteBody);
+	run("quote_parse_dom", 10000, 10, [&] {
+		Quote quote = parse_quote(json::parse(quoteBody, quoteBody + quoteLength));
+		(void)quote;
+	});
+	run("quote_parse_stream", 10000, 10, [&] {
+		RecordCollector<Quote> collector(assign_quote_field, Quote(), false);
+		JsonStreamParser parser(collector);
+		parser.feed(quoteBody, quoteLength);
+		parser.finish();
+	});
+	string batch = batch_body(100);
+	run("quote_batch100_parse_dom", 1000, 1, [&] {
+		json jsonData = json::parse(batch);
+		vector<Quote> quotes;
+		for (auto &jsonQuote : jsonData["results"])
+			quotes.push_back(parse_quote(jsonQuote));
+	});
+	run("quote_batch100_parse_stream", 1000, 1, [&] {
+		RecordCollector<Quote> collector(assign_quote_field, Quote(), true);
+		JsonStreamParser parser(collector);
+		parser.feed(batch.data(), batch.size());
+		parser.finish();
+	});
+
+	//Authentication
+	{
+		RobinhoodAuthentication authentication;
+		run("mfa_code", 10000, 10, [&] { authentication.generateMFACode("JBSWY3DPEHPK3PXP", 30); });
+	}
+
+	//End to end against the loopback server
+	if (filter.empty() || filter.compare(0, 3, "e2e") == 0) {
+		MockServer server;
+		TransportProfile profile;
+		profile.base_url = server.base_url();
+		//Order acks are logged at INFO; keep them out of the results.
+		Logger::instance().set_level(LOG_WARNING);
+		RobinhoodTrader trader(profile);
+		trader.login("bench", "bench", "JBSWY3DPEHPK3PXP");
+		trader.quote_cache().set_ttl(chrono::milliseconds(0));
+		OrderTemplate xlf = trader.make_order_template("XLF", BUY, LIMIT, GFD, IMMEDIATE);
+		vector<string> symbols;
+		for (int i = 0; i < 100; i++)
+			symbols.push_back("S" + to_string(i));
+
+		run("e2e_quote_data", 2000, 1, [&] { trader.quote_data("XLF"); });
+		run("e2e_get_quote", 2000, 1, [&] { trader.get_quote("XLF"); });
+		run("e2e_ask_price", 2000, 1, [&] { trader.ask_price("XLF"); });
+		run("e2e_get_quotes_100", 500, 1, [&] { trader.get_quotes(symbols); });
+		run("e2e_submit_order", 2000, 1, [&] { trader.submit_order(xlf, 1, Price{ 260000 }); });
+		run("e2e_submit_order_async", 2000, 1, [&] { trader.submit_order_async(xlf, 1, Price{ 260000 }).get(); });
+	}
+	return 0;
+}
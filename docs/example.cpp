@@ -1,6 +1,9 @@
 //Test Example for RobinhoodCpp
 #include <iostream>
 #include "robinhoodtrader.h"
+#include "tickrecorder.h"
+#include "mockserver.h"
+#include "logger.h"
 #include "exceptions.h"
 
 using namespace std;
@@ -11,13 +14,61 @@ int main() {
 	*/
 	const string qrCode = "16-characterQRCode";
 
-	RobinhoodTrader trader;
+	//Log to a file instead of stdout; LOG_DEBUG adds order bodies & full responses
+	//Logger::instance().open("robinhood.log");
+	//Logger::instance().set_level(LOG_DEBUG);
+
+	//Pre-connect at startup so the first order doesn't pay for DNS, TCP & TLS setup
+	TransportProfile profile;
+	profile.warm_up = true;
+	RobinhoodTrader trader(profile);
+
+	//Load test against the bundled loopback server: 2ms latency, up to 1ms jitter
+	//MockServer server(0, std::chrono::milliseconds(2), std::chrono::milliseconds(1));
+	//profile.base_url = server.base_url();
+
+	//Offline: replay recorded quotes instead, as fast as the strategy reads them
+	//QuoteReplay::import_json_lines("quotes.jsonl", "ticks");
+	//RobinhoodTrader trader(std::make_shared<QuoteReplay>(std::vector<std::string>{ "ticks/ticks-20190301.rht" }));
+
+	//Paper trading: orders fill against those quotes & positions()/get_orders()/get_account() report the simulation
+	//RobinhoodTrader trader(std::make_shared<PaperExchange>(Price::from_double(25000)),
+	//						std::make_shared<QuoteReplay>(std::vector<std::string>{ "ticks/ticks-20190301.rht" }));
+	//Reuse the previous run's session (the token is refreshed in the background) & only log in without one
+	//if (!trader.restore_session("robinhood.session", "passphrase")) {
 	trader.login("Username", "Password", qrCode);
+	//	trader.persist_session("robinhood.session", "passphrase");
+	//}
+
+	//Reuse instrument URLs from the previous run so orders skip the quote lookup
+	//trader.instrument_cache().load("instruments.txt");
 
 	//Get ask price
 	float askPrice = trader.ask_price("XLF");
 	cout << "XLF ask price: " << askPrice  << endl;
+
+	//Quotes are reused for 500ms by default; bid_price() below costs no request
+	//trader.quote_cache().set_ttl(std::chrono::milliseconds(250));
+	//cout << "XLF bid price: " << trader.bid_price("XLF") << endl;
+
+	//Keep XLF & SPY quotes refreshed in the background; ask_price() then reads memory
+	//trader.quote_poller().subscribe("XLF");
+	//trader.quote_poller().subscribe("SPY");
+	//Record every poll to ticks/ticks-YYYYMMDD.rht
+	//TickRecorder recorder("ticks");
+	//trader.quote_poller().set_listener([&recorder](const std::vector<Quote> &quotes) { recorder.record(quotes); });
+	//trader.quote_poller().start();
+	//cout << "poll latency: " << trader.quote_poller().stats().last_cycle.count() << "us" << endl;
+
+	//Get ask prices for several stocks in one request
+	//auto askPrices = trader.ask_price_batch({ "XLF", "SPY", "QQQ" });
+	//cout << "SPY ask price: " << askPrices["SPY"] << endl;
 		
+	//Read positions & account concurrently
+	//auto positionsFuture = trader.positions_async();
+	//auto accountFuture = trader.get_account_async();
+	//cout << "positions(): " << positionsFuture.get().dump() << " account: " << accountFuture.get().dump() << endl;
+
 	//Get account info
 	//cout << "get_account(): " << trader.get_account() << endl;
 		
@@ -31,6 +82,11 @@ int main() {
 
 	//json orders = trader.get_orders("XLF");
 	//cout << "get_orders(XLF): " << orders.dump();
+
+	//Orders changed since the previous call (every order on the first), fetched page by page
+	//vector<Order> changed = trader.sync_orders();
+	//cout << "open XLF orders: " << trader.order_manager().open_count(SymbolTable::instance().intern("XLF")) << endl;
+	//cout << "net exposure: " << trader.position_ledger().exposure().net().to_double() << endl;
 		
 	//Place limit buy order
 	//trader.place_limit_buy_order("XLF", 1, 26.00, GTC);
@@ -38,12 +94,26 @@ int main() {
 	//Place limit sell order
 	//trader.place_limit_sell_order("XLF", 1, 26.78, GTC);
 
+	//Repeated limit buys on the same instrument with a pre-encoded order
+	//OrderTemplate xlfBuy = trader.make_order_template("XLF", BUY, LIMIT, GFD, IMMEDIATE);
+	//trader.submit_order(xlfBuy, 1, Price::from_double(26.00));
+
+	//Queue the order without blocking; the ack carries the order id, state & cancel URL
+	//std::future<Order> ack = trader.submit_order_async(xlfBuy, 1, Price::from_double(26.00));
+	//cout << "order id: " << ack.get().id.data << endl;
+
 	//place_market_sell_order
 
 	//trader.place_market_sell_order("XLF", 1, GFD);
 
+	//Save instrument URLs for the next run
+	//trader.instrument_cache().save("instruments.txt");
+
 	//Cancel order using order_id
 	//trader.cancel_order("87b730be-93f3-4e3d-9cf1-8b4ee8878f7b"); 
+
+	//Cancel all working XLF orders
+	//trader.cancel_all_orders("XLF");
 		
 	return 0;
 }
@@ -14,3 +14,5 @@ const std::string quotes_url = api_url + "/quotes/";
 const std::string orders_url = api_url + "/orders/"; 
 
 const std::string accounts_url = api_url + "/accounts/";
+
+const std::string instruments_url = api_url + "/instruments/";
@@ -0,0 +1,101 @@
+/* instrumentcache.cpp: symbol <-> instrument cache with an on-disk snapshot */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "instrumentcache.h"
+#include "exceptions.h"
+
+using namespace std;
+
+bool InstrumentCache::find(const string &symbol, RobinhoodId &instrument) const {
+	SymbolId id = SymbolTable::instance().find(symbol);
+	if (id == 0)
+		return false;
+
+	lock_guard<mutex> lock(cache_mutex);
+	auto it = instruments.find(id);
+	if (it == instruments.end())
+		return false;
+	instrument = it->second;
+	return true;
+}
+
+SymbolId InstrumentCache::find_symbol(const RobinhoodId &instrument) const {
+	lock_guard<mutex> lock(cache_mutex);
+	auto it = symbols.find(instrument.data);
+	return it == symbols.end() ? 0 : it->second;
+}
+
+void InstrumentCache::insert(SymbolId symbol, const RobinhoodId &instrument) {
+	if (symbol == 0 || instrument.empty())
+		return;
+	lock_guard<mutex> lock(cache_mutex);
+	//Drop the pairings this one replaces, so neither direction can return a stale mapping.
+	auto previous = instruments.find(symbol);
+	if (previous != instruments.end() && strcmp(previous->second.data, instrument.data) != 0)
+		symbols.erase(previous->second.data);
+	auto owner = symbols.find(instrument.data);
+	if (owner != symbols.end() && owner->second != symbol)
+		instruments.erase(owner->second);
+	instruments[symbol] = instrument;
+	symbols[instrument.data] = symbol;
+}
+
+void InstrumentCache::merge(const InstrumentCache &other) {
+	if (&other == this)
+		return;
+	//Copy first so the two caches are never locked together.
+	unordered_map<SymbolId, RobinhoodId> entries;
+	{
+		lock_guard<mutex> lock(other.cache_mutex);
+		entries = other.instruments;
+	}
+	for (auto &entry : entries)
+		insert(entry.first, entry.second);
+}
+
+size_t InstrumentCache::size() const {
+	lock_guard<mutex> lock(cache_mutex);
+	return instruments.size();
+}
+
+void InstrumentCache::clear() {
+	lock_guard<mutex> lock(cache_mutex);
+	instruments.clear();
+	symbols.clear();
+}
+
+//load(): Snapshot format is one "SYMBOL instrument_id" pair per line.
+bool InstrumentCache::load(const string &path) {
+	ifstream in(path);
+	if (!in)
+		return false;
+
+	string line, symbol, instrumentId;
+	while (getline(in, line)) {
+		istringstream fields(line);
+		if (!(fields >> symbol >> instrumentId))
+			continue;
+		RobinhoodId instrument;
+		instrument.assign(instrumentId);
+		//find() looks symbols up in upper case.
+		std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+		insert(SymbolTable::instance().intern(symbol), instrument);
+	}
+	return true;
+}
+
+void InstrumentCache::save(const string &path) const {
+	ofstream out(path, ios::trunc);
+	if (!out)
+		throw RobinhoodException("InstrumentCache::save(): Could not open " + path);
+
+	lock_guard<mutex> lock(cache_mutex);
+	for (auto &entry : instruments)
+		out << SymbolTable::instance().name(entry.first) << ' ' << entry.second.data << '\n';
+	if (!out)
+		throw RobinhoodException("InstrumentCache::save(): Could not write " + path);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include "records.h"
+
+/* InstrumentCache: symbol <-> instrument id map so orders don't need a quote round trip to find
+   the instrument.  Filled from every quote the trader decodes; a snapshot can be saved & loaded
+   at startup.  Thread safe.
+*/
+class InstrumentCache {
+public:
+	//find(): Instrument of symbol (upper case). Returns false if not cached.
+	bool find(const std::string &symbol, RobinhoodId &instrument) const;
+	//find_symbol(): Symbol of an instrument id. Returns 0 if not cached.
+	SymbolId find_symbol(const RobinhoodId &instrument) const;
+	void insert(SymbolId symbol, const RobinhoodId &instrument);
+	//merge(): Insert every entry of other.
+	void merge(const InstrumentCache &other);
+	std::size_t size() const;
+	void clear();
+
+	//load(): Merge a snapshot written by save(). Returns false if the file doesn't exist.
+	//Symbols are stored upper case, whatever case the file has.
+	bool load(const std::string &path);
+	void save(const std::string &path) const;
+
+private:
+	mutable std::mutex cache_mutex;
+	std::unordered_map<SymbolId, RobinhoodId> instruments;
+	std::unordered_map<std::string, SymbolId> symbols;
+};
@@ -0,0 +1,221 @@
+/* jsonstream.cpp: incremental JSON tokenizer used to decode responses as they arrive */
+
+#include "jsonstream.h"
+#include "exceptions.h"
+
+using namespace std;
+
+static inline bool is_bare_char(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static inline int hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+JsonStreamParser::JsonStreamParser(JsonStreamHandler &handler)
+	: handler(handler) {
+	reset();
+}
+
+void JsonStreamParser::reset() {
+	state = DEFAULT;
+	containers.clear();
+	expectKey = false;
+	buffer.clear();
+	unicode = 0;
+	unicodeDigits = 0;
+	highSurrogate = 0;
+}
+
+void JsonStreamParser::emit_string(const char *text, size_t len) {
+	if (expectKey && !containers.empty() && containers.back() == '{')
+		handler.key(text, len);
+	else
+		handler.value(text, len, true);
+}
+
+void JsonStreamParser::emit_bare(const char *text, size_t len) {
+	if (len == 4 && text[0] == 'n' && text[1] == 'u' && text[2] == 'l' && text[3] == 'l')
+		handler.value(nullptr, 0, false);
+	else
+		handler.value(text, len, false);
+}
+
+void JsonStreamParser::append_utf8(unsigned cp) {
+	if (cp < 0x80)
+		buffer += static_cast<char>(cp);
+	else if (cp < 0x800) {
+		buffer += static_cast<char>(0xC0 | (cp >> 6));
+		buffer += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else if (cp < 0x10000) {
+		buffer += static_cast<char>(0xE0 | (cp >> 12));
+		buffer += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		buffer += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else {
+		buffer += static_cast<char>(0xF0 | (cp >> 18));
+		buffer += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		buffer += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		buffer += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+//feed(): Decode the next chunk of the document.
+void JsonStreamParser::feed(const char *data, size_t len) {
+	size_t i = 0;
+	while (i < len) {
+		switch (state) {
+		case DEFAULT: {
+			char c = data[i];
+			switch (c) {
+			case ' ': case '\t': case '\r': case '\n':
+				break;
+			case '{':
+				containers.push_back('{');
+				expectKey = true;
+				handler.start_object();
+				break;
+			case '[':
+				containers.push_back('[');
+				expectKey = false;
+				handler.start_array();
+				break;
+			case '}':
+			case ']':
+				if (containers.empty() || containers.back() != (c == '}' ? '{' : '['))
+					throw RobinhoodException("JsonStreamParser: unbalanced '" + string(1, c) + "'");
+				containers.pop_back();
+				expectKey = false;
+				if (c == '}')
+					handler.end_object();
+				else
+					handler.end_array();
+				break;
+			case ':':
+				expectKey = false;
+				break;
+			case ',':
+				expectKey = !containers.empty() && containers.back() == '{';
+				break;
+			case '"': {
+				//Fast path: the whole string is in this chunk & has no escapes.
+				size_t start = i + 1, j = start;
+				while (j < len && data[j] != '"' && data[j] != '\\')
+					j++;
+				if (j < len && data[j] == '"') {
+					emit_string(data + start, j - start);
+					i = j;
+				}
+				else {
+					buffer.assign(data + start, j - start);
+					state = IN_STRING;
+					i = j - 1;
+				}
+				break;
+			}
+			default:
+				if (!is_bare_char(c))
+					throw RobinhoodException("JsonStreamParser: unexpected character '" + string(1, c) + "'");
+				{
+					size_t j = i;
+					while (j < len && is_bare_char(data[j]))
+						j++;
+					if (j < len) {
+						emit_bare(data + i, j - i);
+						i = j - 1;
+					}
+					else {
+						buffer.assign(data + i, j - i);
+						state = IN_BARE;
+						i = j - 1;
+					}
+				}
+				break;
+			}
+			i++;
+			break;
+		}
+		case IN_STRING: {
+			size_t j = i;
+			while (j < len && data[j] != '"' && data[j] != '\\')
+				j++;
+			buffer.append(data + i, j - i);
+			if (j == len) {
+				i = j;
+			}
+			else if (data[j] == '"') {
+				state = DEFAULT;
+				emit_string(buffer.data(), buffer.size());
+				i = j + 1;
+			}
+			else {
+				state = IN_ESCAPE;
+				i = j + 1;
+			}
+			break;
+		}
+		case IN_ESCAPE: {
+			char c = data[i++];
+			state = IN_STRING;
+			switch (c) {
+			case 'b': buffer += '\b'; break;
+			case 'f': buffer += '\f'; break;
+			case 'n': buffer += '\n'; break;
+			case 'r': buffer += '\r'; break;
+			case 't': buffer += '\t'; break;
+			case 'u':
+				state = IN_UNICODE;
+				unicode = 0;
+				unicodeDigits = 0;
+				break;
+			default: buffer += c; break;
+			}
+			break;
+		}
+		case IN_UNICODE: {
+			int digit = hex_value(data[i++]);
+			if (digit < 0)
+				throw RobinhoodException("JsonStreamParser: invalid \\u escape");
+			unicode = (unicode << 4) | static_cast<unsigned>(digit);
+			if (++unicodeDigits == 4) {
+				state = IN_STRING;
+				if (unicode >= 0xD800 && unicode <= 0xDBFF)
+					highSurrogate = unicode;
+				else if (unicode >= 0xDC00 && unicode <= 0xDFFF && highSurrogate) {
+					append_utf8(0x10000 + ((highSurrogate - 0xD800) << 10) + (unicode - 0xDC00));
+					highSurrogate = 0;
+				}
+				else
+					append_utf8(unicode);
+			}
+			break;
+		}
+		case IN_BARE: {
+			size_t j = i;
+			while (j < len && is_bare_char(data[j]))
+				j++;
+			buffer.append(data + i, j - i);
+			i = j;
+			if (j < len) {
+				state = DEFAULT;
+				emit_bare(buffer.data(), buffer.size());
+			}
+			break;
+		}
+		}
+	}
+}
+
+void JsonStreamParser::finish() {
+	if (state == IN_BARE) {
+		state = DEFAULT;
+		emit_bare(buffer.data(), buffer.size());
+	}
+	if (state != DEFAULT || !containers.empty())
+		throw RobinhoodException("JsonStreamParser: incomplete JSON document");
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* JsonStreamHandler: receives the tokens of a JSON document as JsonStreamParser decodes them.
+   Strings arrive unquoted & unescaped.  Numbers & booleans arrive as their JSON text with
+   isString false, and null arrives as text == nullptr.  Pointers are only valid during the call.
+*/
+class JsonStreamHandler {
+public:
+	virtual ~JsonStreamHandler() {}
+	virtual void start_object() = 0;
+	virtual void end_object() = 0;
+	virtual void start_array() = 0;
+	virtual void end_array() = 0;
+	virtual void key(const char *text, std::size_t len) = 0;
+	virtual void value(const char *text, std::size_t len, bool isString) = 0;
+};
+
+/* JsonStreamParser: incremental (push) JSON tokenizer.  feed() accepts the document in arbitrary
+   chunks as they arrive from the network, so no full copy of the body or DOM is ever built.
+   Tokens split across chunks are reassembled in a small reusable buffer.
+*/
+class JsonStreamParser {
+public:
+	explicit JsonStreamParser(JsonStreamHandler &handler);
+
+	void feed(const char *data, std::size_t len);
+	//finish(): Flush a trailing scalar & check the document is complete. Throws RobinhoodException otherwise.
+	void finish();
+	void reset();
+
+private:
+	enum State { DEFAULT, IN_STRING, IN_ESCAPE, IN_UNICODE, IN_BARE };
+
+	void emit_string(const char *text, std::size_t len);
+	void emit_bare(const char *text, std::size_t len);
+	void append_utf8(unsigned codepoint);
+
+	JsonStreamHandler &handler;
+	State state;
+	std::vector<char> containers;    //'{' or '[' for each open container
+	bool expectKey;
+	std::string buffer;              //partial token carried across chunks or unescaped string
+	unsigned unicode;
+	int unicodeDigits;
+	unsigned highSurrogate;
+};
+
+/* RecordCollector: JsonStreamHandler that fills typed records through one of the assign_*_field()
+   functions in recordparser.h.  Records are either the root object of the response or the objects
+   of its top-level "results" array; null entries in "results" are skipped.  The top-level "next"
+   page link is kept as well.
+*/
+template <typename Record>
+class RecordCollector : public JsonStreamHandler {
+public:
+	typedef void (*Assign)(Record &, const char *, std::size_t, const char *, std::size_t);
+
+	RecordCollector(Assign assign, const Record &blank, bool resultsList)
+		: assign(assign), blank(blank), resultsList(resultsList), depth(0), inResults(false), inRecord(false) {}
+
+	std::vector<Record> records;
+	std::string next;
+
+	void start_object() override {
+		depth++;
+		if ((!resultsList && depth == 1) || (inResults && depth == 3)) {
+			records.push_back(blank);
+			inRecord = true;
+		}
+	}
+	void end_object() override {
+		if ((!resultsList && depth == 1) || (inResults && depth == 3))
+			inRecord = false;
+		depth--;
+	}
+	void start_array() override {
+		depth++;
+		if (resultsList && depth == 2 && currentKey == "results")
+			inResults = true;
+	}
+	void end_array() override {
+		if (inResults && depth == 2)
+			inResults = false;
+		depth--;
+	}
+	void key(const char *text, std::size_t len) override {
+		currentKey.assign(text, len);
+	}
+	void value(const char *text, std::size_t len, bool) override {
+		if (inRecord && depth == (resultsList ? 3 : 1))
+			assign(records.back(), currentKey.data(), currentKey.size(), text, len);
+		else if (depth == 1 && currentKey == "next") {
+			if (text)
+				next.assign(text, len);
+			else
+				next.clear();
+		}
+	}
+
+private:
+	Assign assign;
+	Record blank;
+	bool resultsList;
+	int depth;
+	bool inResults;
+	bool inRecord;
+	std::string currentKey;
+};
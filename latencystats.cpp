@@ -0,0 +1,354 @@
+/* latencystats.cpp: lock-free per-endpoint request latency histograms & their export */
+
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+
+#include "latencystats.h"
+#include "exceptions.h"
+
+using namespace std;
+
+static const char *const phaseNames[PHASE_COUNT] = { "namelookup", "connect", "appconnect", "starttransfer", "total", "parse" };
+
+const char *phase_name(LatencyPhase phase) {
+	return phaseNames[phase];
+}
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+void LatencyHistogram::reset() {
+	for (auto &count : counts)
+		count.store(0, memory_order_relaxed);
+	sum.store(0, memory_order_relaxed);
+	min_value.store(UINT64_MAX, memory_order_relaxed);
+	max_value.store(0, memory_order_relaxed);
+}
+
+int LatencyHistogram::bucket_of(uint64_t value) {
+	if (value < 2 * subBuckets)
+		return int(value);
+	int exponent = 63;
+	while (!(value >> exponent))
+		exponent--;
+	if (exponent > maxExponent)
+		return bucketCount - 1;
+	return (exponent - 3) * subBuckets + int((value >> (exponent - 4)) & (subBuckets - 1));
+}
+
+uint64_t LatencyHistogram::bucket_lower(int bucket) {
+	if (bucket < 2 * subBuckets)
+		return uint64_t(bucket);
+	int exponent = bucket / subBuckets + 3;
+	return uint64_t(subBuckets + bucket % subBuckets) << (exponent - 4);
+}
+
+//record(): Count value. Negative values (curl reports -1 for unknown sizes) count as 0.
+void LatencyHistogram::record(int64_t value) {
+	uint64_t v = value > 0 ? uint64_t(value) : 0;
+	counts[bucket_of(v)].fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(v, memory_order_relaxed);
+
+	uint64_t seen = min_value.load(memory_order_relaxed);
+	while (v < seen && !min_value.compare_exchange_weak(seen, v, memory_order_relaxed))
+		;
+	seen = max_value.load(memory_order_relaxed);
+	while (v > seen && !max_value.compare_exchange_weak(seen, v, memory_order_relaxed))
+		;
+}
+
+//Counts are read one by one while recording continues, so count may lag the buckets slightly.
+HistogramSnapshot::HistogramSnapshot(const LatencyHistogram &histogram)
+	: counts(LatencyHistogram::bucketCount) {
+	count = 0;
+	for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+		counts[i] = histogram.counts[i].load(memory_order_relaxed);
+		count += counts[i];
+	}
+	sum = histogram.sum.load(memory_order_relaxed);
+	min = count ? histogram.min_value.load(memory_order_relaxed) : 0;
+	max = histogram.max_value.load(memory_order_relaxed);
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+	if (count == 0)
+		return 0;
+	uint64_t rank = uint64_t(p / 100.0 * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		seen += counts[i];
+		if (seen >= rank) {
+			//Report the bucket's upper end, but never beyond the largest sample.
+			uint64_t upper = i + 1 < counts.size() ? LatencyHistogram::bucket_lower(int(i + 1)) - 1 : max;
+			return upper < max ? upper : max;
+		}
+	}
+	return max;
+}
+
+LatencyStats::Endpoint::Endpoint(const string &name)
+	: name(name) {
+	reset();
+}
+
+void LatencyStats::Endpoint::reset() {
+	requests.store(0, memory_order_relaxed);
+	failures.store(0, memory_order_relaxed);
+	for (auto &count : status)
+		count.store(0, memory_order_relaxed);
+	bytes_sent.store(0, memory_order_relaxed);
+	bytes_received.store(0, memory_order_relaxed);
+	for (auto &phase : phases)
+		phase.reset();
+}
+
+LatencyStats::LatencyStats()
+	: table(new atomic<Endpoint *>[maxEndpoints]), other("other") {
+	for (size_t i = 0; i < maxEndpoints; i++)
+		table[i].store(nullptr, memory_order_relaxed);
+}
+
+LatencyStats::~LatencyStats() {
+	for (size_t i = 0; i < maxEndpoints; i++)
+		delete table[i].load(memory_order_relaxed);
+}
+
+//is_id(): Path segments that are ids rather than resource names: UUIDs, account numbers & symbols.
+static bool is_id(const string &segment) {
+	bool digit = false;
+	for (char c : segment) {
+		if (c >= 'A' && c <= 'Z')
+			return true;
+		if (c >= '0' && c <= '9')
+			digit = true;
+	}
+	return digit && segment.size() >= 8;
+}
+
+//endpoint_of(): Path of url without scheme, host & query, ids replaced by "{id}".
+string LatencyStats::endpoint_of(const string &url) {
+	size_t start = url.find("://");
+	start = start == string::npos ? 0 : url.find('/', start + 3);
+	if (start == string::npos)
+		return "/";
+	size_t end = url.find_first_of("?#", start);
+	if (end == string::npos)
+		end = url.size();
+
+	string endpoint;
+	endpoint.reserve(end - start);
+	size_t pos = start;
+	while (pos < end) {
+		size_t slash = url.find('/', pos + 1);
+		if (slash == string::npos || slash > end)
+			slash = end;
+		string segment = url.substr(pos + 1, slash - pos - 1);
+		endpoint += '/';
+		endpoint += is_id(segment) ? "{id}" : segment;
+		pos = slash;
+	}
+	return endpoint.empty() ? "/" : endpoint;
+}
+
+//endpoint(): Find or insert the entry of url's endpoint. Linear probing; slots are claimed with compare & swap.
+LatencyStats::Endpoint &LatencyStats::endpoint(const string &url) {
+	string name = endpoint_of(url);
+	size_t slot = hash<string>()(name) % maxEndpoints;
+	for (size_t probe = 0; probe < maxEndpoints; probe++, slot = (slot + 1) % maxEndpoints) {
+		Endpoint *entry = table[slot].load(memory_order_acquire);
+		if (!entry) {
+			unique_ptr<Endpoint> created(new Endpoint(name));
+			if (table[slot].compare_exchange_strong(entry, created.get(), memory_order_acq_rel))
+				return *created.release();
+			//Another thread claimed the slot first; entry now holds its endpoint.
+		}
+		if (entry->name == name)
+			return *entry;
+	}
+	return other;
+}
+
+void LatencyStats::record_transfer(const string &url, CURL *easy, CURLcode result) {
+	Endpoint &entry = endpoint(url);
+	entry.requests.fetch_add(1, memory_order_relaxed);
+
+	long httpCode = 0;
+	curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &httpCode);
+	if (result != CURLE_OK && httpCode == 0)
+		entry.failures.fetch_add(1, memory_order_relaxed);
+	long statusClass = httpCode / 100;
+	entry.status[statusClass >= 1 && statusClass <= 5 ? statusClass : 0].fetch_add(1, memory_order_relaxed);
+
+	//libcurl reports each time from the start of the transfer; record the phases' own durations.
+	curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+	curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+	curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+	curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+	curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+
+	curl_off_t connected = connect > namelookup ? connect : namelookup;
+	curl_off_t secured = appconnect > connected ? appconnect : connected;
+	entry.phases[NAMELOOKUP].record(namelookup);
+	entry.phases[CONNECT].record(connected - namelookup);
+	entry.phases[APPCONNECT].record(secured - connected);
+	entry.phases[STARTTRANSFER].record(starttransfer ? starttransfer - secured : 0);
+	entry.phases[TOTAL].record(total);
+
+	curl_off_t sent = 0, received = 0;
+	curl_easy_getinfo(easy, CURLINFO_SIZE_UPLOAD_T, &sent);
+	curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &received);
+	entry.bytes_sent.fetch_add(uint64_t(sent > 0 ? sent : 0), memory_order_relaxed);
+	entry.bytes_received.fetch_add(uint64_t(received > 0 ? received : 0), memory_order_relaxed);
+}
+
+void LatencyStats::record_parse(const string &url, int64_t micros) {
+	endpoint(url).phases[PARSE].record(micros);
+}
+
+//snapshot(): Every endpoint that saw a request, sorted by name.
+vector<EndpointSnapshot> LatencyStats::snapshot() const {
+	vector<const Endpoint *> entries;
+	for (size_t i = 0; i < maxEndpoints; i++) {
+		const Endpoint *entry = table[i].load(memory_order_acquire);
+		if (entry)
+			entries.push_back(entry);
+	}
+	entries.push_back(&other);
+	sort(entries.begin(), entries.end(), [](const Endpoint *a, const Endpoint *b) { return a->name < b->name; });
+
+	vector<EndpointSnapshot> result;
+	for (const Endpoint *entry : entries) {
+		EndpointSnapshot endpoint;
+		endpoint.endpoint = entry->name;
+		endpoint.requests = entry->requests.load(memory_order_relaxed);
+		endpoint.failures = entry->failures.load(memory_order_relaxed);
+		for (int i = 0; i < 6; i++)
+			endpoint.status[i] = entry->status[i].load(memory_order_relaxed);
+		endpoint.bytes_sent = entry->bytes_sent.load(memory_order_relaxed);
+		endpoint.bytes_received = entry->bytes_received.load(memory_order_relaxed);
+		for (int i = 0; i < PHASE_COUNT; i++)
+			endpoint.phases[i] = HistogramSnapshot(entry->phases[i]);
+		if (endpoint.requests || endpoint.phases[PARSE].count)
+			result.push_back(std::move(endpoint));
+	}
+	return result;
+}
+
+//reset(): Zero every counter; endpoints stay registered.
+void LatencyStats::reset() {
+	for (size_t i = 0; i < maxEndpoints; i++) {
+		Endpoint *entry = table[i].load(memory_order_acquire);
+		if (entry)
+			entry->reset();
+	}
+	other.reset();
+}
+
+string LatencyStats::to_text() const {
+	ostringstream out;
+	for (const EndpointSnapshot &endpoint : snapshot()) {
+		out << endpoint.endpoint << "  requests " << endpoint.requests << "  failures " << endpoint.failures
+			<< "  2xx " << endpoint.status[2] << "  4xx " << endpoint.status[4] << "  5xx " << endpoint.status[5]
+			<< "  sent " << endpoint.bytes_sent << "B  received " << endpoint.bytes_received << "B\n";
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			const HistogramSnapshot &phase = endpoint.phases[i];
+			if (!phase.count)
+				continue;
+			out << "    " << left << setw(14) << phase_name(LatencyPhase(i)) << right
+				<< " n " << setw(8) << phase.count
+				<< "  mean " << setw(9) << fixed << setprecision(1) << phase.mean()
+				<< "  p50 " << setw(8) << phase.percentile(50)
+				<< "  p90 " << setw(8) << phase.percentile(90)
+				<< "  p99 " << setw(8) << phase.percentile(99)
+				<< "  p99.9 " << setw(8) << phase.percentile(99.9)
+				<< "  max " << setw(8) << phase.max << " us\n";
+		}
+	}
+	return out.str();
+}
+
+//label(): Prometheus label value; endpoints contain no quotes or backslashes but escape them anyway.
+static string label(const string &value) {
+	string escaped;
+	for (char c : value) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+string LatencyStats::to_prometheus() const {
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	static const char *const statusNames[6] = { "none", "1xx", "2xx", "3xx", "4xx", "5xx" };
+	vector<EndpointSnapshot> endpoints = snapshot();
+	ostringstream out;
+	out << setprecision(9);
+
+	out << "# HELP robinhood_request_phase_seconds Duration of each phase of a request.\n"
+		<< "# TYPE robinhood_request_phase_seconds summary\n";
+	for (const EndpointSnapshot &endpoint : endpoints) {
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			const HistogramSnapshot &phase = endpoint.phases[i];
+			if (!phase.count)
+				continue;
+			string labels = "endpoint=\"" + label(endpoint.endpoint) + "\",phase=\"" + phase_name(LatencyPhase(i)) + "\"";
+			for (double q : quantiles)
+				out << "robinhood_request_phase_seconds{" << labels << ",quantile=\"" << q << "\"} "
+					<< phase.percentile(q * 100) / 1e6 << "\n";
+			out << "robinhood_request_phase_seconds_sum{" << labels << "} " << phase.sum / 1e6 << "\n"
+				<< "robinhood_request_phase_seconds_count{" << labels << "} " << phase.count << "\n";
+		}
+	}
+
+	out << "# HELP robinhood_requests_total Completed requests by HTTP status class.\n"
+		<< "# TYPE robinhood_requests_total counter\n";
+	for (const EndpointSnapshot &endpoint : endpoints)
+		for (int i = 0; i < 6; i++)
+			if (endpoint.status[i])
+				out << "robinhood_requests_total{endpoint=\"" << label(endpoint.endpoint) << "\",status=\"" << statusNames[i] << "\"} "
+					<< endpoint.status[i] << "\n";
+
+	out << "# HELP robinhood_request_failures_total Requests that failed without an HTTP response.\n"
+		<< "# TYPE robinhood_request_failures_total counter\n";
+	for (const EndpointSnapshot &endpoint : endpoints)
+		out << "robinhood_request_failures_total{endpoint=\"" << label(endpoint.endpoint) << "\"} " << endpoint.failures << "\n";
+
+	out << "# HELP robinhood_request_bytes_sent_total Request body bytes sent.\n"
+		<< "# TYPE robinhood_request_bytes_sent_total counter\n";
+	for (const EndpointSnapshot &endpoint : endpoints)
+		out << "robinhood_request_bytes_sent_total{endpoint=\"" << label(endpoint.endpoint) << "\"} " << endpoint.bytes_sent << "\n";
+
+	out << "# HELP robinhood_request_bytes_received_total Response body bytes received.\n"
+		<< "# TYPE robinhood_request_bytes_received_total counter\n";
+	for (const EndpointSnapshot &endpoint : endpoints)
+		out << "robinhood_request_bytes_received_total{endpoint=\"" << label(endpoint.endpoint) << "\"} " << endpoint.bytes_received << "\n";
+	return out.str();
+}
+
+//dump(): Written to a temporary file & renamed, so a scraper never reads a half written file.
+void LatencyStats::dump(const string &path, bool prometheus) const {
+	string temporary = path + ".tmp";
+	{
+		ofstream file(temporary, ios::binary | ios::trunc);
+		if (!file)
+			throw RobinhoodException("LatencyStats::dump(): Could not open " + temporary);
+		file << (prometheus ? to_prometheus() : to_text());
+		if (!file)
+			throw RobinhoodException("LatencyStats::dump(): Could not write " + temporary);
+	}
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		if (rename(temporary.c_str(), path.c_str()) != 0)
+			throw RobinhoodException("LatencyStats::dump(): Could not replace " + path);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <curl/curl.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+/* LatencyHistogram: HDR style histogram of non-negative integer samples (microseconds or bytes).
+   Values below 32 have a bucket each; above that every power of two is split into 16 linear
+   sub-buckets, so any recorded value is known to within 1/16 (~6%).  record() is a handful
+   of relaxed atomic increments & never blocks; values past the top bucket land in it.
+*/
+class LatencyHistogram {
+public:
+	static const int subBuckets = 16;
+	static const int maxExponent = 40;     //top bucket starts at 2^40 (~12.7 days in microseconds)
+	static const int bucketCount = (maxExponent - 2) * subBuckets;
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+	void record(int64_t value);
+	void reset();
+
+	static int bucket_of(uint64_t value);
+	//bucket_lower(): Smallest value that falls into bucket; the bucket ends where the next begins.
+	static uint64_t bucket_lower(int bucket);
+
+private:
+	friend struct HistogramSnapshot;
+
+	std::atomic<uint64_t> counts[bucketCount];
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> min_value;
+	std::atomic<uint64_t> max_value;
+};
+
+//HistogramSnapshot: copy of a LatencyHistogram taken at one point in time.
+struct HistogramSnapshot {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	std::vector<uint64_t> counts;          //per bucket, see LatencyHistogram::bucket_lower()
+
+	HistogramSnapshot() : count(0), sum(0), min(0), max(0) {}
+	explicit HistogramSnapshot(const LatencyHistogram &histogram);
+
+	double mean() const { return count ? double(sum) / count : 0.0; }
+	//percentile(): Value at or below which p percent (0-100) of the samples fall, to bucket precision.
+	uint64_t percentile(double p) const;
+};
+
+/* Phases of a request, each recorded as its own duration in microseconds:
+   NAMELOOKUP (DNS), CONNECT (TCP), APPCONNECT (TLS), STARTTRANSFER (request sent until the first
+   response byte), TOTAL (the whole transfer) & PARSE (decoding the response as JSON).  Phases
+   a reused connection skips are recorded as 0.
+*/
+enum LatencyPhase { NAMELOOKUP, CONNECT, APPCONNECT, STARTTRANSFER, TOTAL, PARSE, PHASE_COUNT };
+
+const char *phase_name(LatencyPhase phase);
+
+//EndpointSnapshot: everything recorded for one endpoint.
+struct EndpointSnapshot {
+	std::string endpoint;
+	uint64_t requests;
+	uint64_t failures;                     //transfers that failed before an HTTP status arrived
+	uint64_t status[6];                    //by status class: [0] none, [1] 1xx ... [5] 5xx
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	HistogramSnapshot phases[PHASE_COUNT];
+};
+
+/* LatencyStats: per-endpoint request timings, status counts & byte counts.  Endpoints are the
+   URL path with ids replaced by "{id}", e.g. "/orders/{id}/cancel/".  Recording never takes a
+   lock: endpoints live in a fixed open addressing table that only grows by compare & swap,
+   and everything past the table's capacity is counted under "other".
+*/
+class LatencyStats {
+public:
+	static const std::size_t maxEndpoints = 128;
+
+	LatencyStats();
+	~LatencyStats();
+
+	LatencyStats(const LatencyStats &) = delete;
+	LatencyStats &operator=(const LatencyStats &) = delete;
+
+	//record_transfer(): Timings, status & sizes of a finished transfer on easy. Call before easy is reused.
+	void record_transfer(const std::string &url, CURL *easy, CURLcode result);
+	//record_parse(): Time spent decoding the response of url.
+	void record_parse(const std::string &url, int64_t micros);
+
+	//endpoint_of(): The endpoint url is counted under.
+	static std::string endpoint_of(const std::string &url);
+
+	std::vector<EndpointSnapshot> snapshot() const;
+	void reset();
+
+	//Human readable table, one line per endpoint & phase.
+	std::string to_text() const;
+	//Prometheus text exposition format: summaries for the phases, counters for the rest.
+	std::string to_prometheus() const;
+	//dump(): Write to_prometheus() (or to_text()) to path. Throws RobinhoodException on failure.
+	void dump(const std::string &path, bool prometheus = true) const;
+
+private:
+	struct Endpoint {
+		std::string name;
+		std::atomic<uint64_t> requests;
+		std::atomic<uint64_t> failures;
+		std::atomic<uint64_t> status[6];
+		std::atomic<uint64_t> bytes_sent;
+		std::atomic<uint64_t> bytes_received;
+		LatencyHistogram phases[PHASE_COUNT];
+
+		explicit Endpoint(const std::string &name);
+		void reset();
+	};
+
+	Endpoint &endpoint(const std::string &url);
+
+	std::unique_ptr<std::atomic<Endpoint *>[]> table;
+	Endpoint other;
+};
@@ -0,0 +1,268 @@
+/* logger.cpp: asynchronous logger; callers only copy arguments, a background thread formats & writes */
+
+#include <chrono>
+#include <algorithm>
+#include <utility>
+
+#include "logger.h"
+#include "exceptions.h"
+#include "recordparser.h"
+
+using namespace std;
+
+static const char *const levelNames[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+void LogRecord::put_string(const char *text, size_t len) {
+	if (size + 3 > payloadSize)
+		return;
+	if (len > payloadSize - size - 3)
+		len = payloadSize - size - 3;
+	uint16_t length = uint16_t(len);
+	payload[size] = char(ARG_STRING);
+	memcpy(payload + size + 1, &length, sizeof(length));
+	memcpy(payload + size + 3, text, len);
+	size += uint32_t(3 + len);
+}
+
+//append_price(): Fixed-point price as a decimal with at least 2 decimal places.
+static void append_price(string &out, int64_t ticks) {
+	if (ticks < 0) {
+		out += '-';
+		ticks = -ticks;
+	}
+	out += to_string(ticks / price_scale);
+	char fraction[8];
+	snprintf(fraction, sizeof(fraction), ".%04d", int(ticks % price_scale));
+	size_t digits = 5;
+	while (digits > 3 && fraction[digits - 1] == '0')
+		digits--;
+	out.append(fraction, digits);
+}
+
+void LogRecord::format_to(string &out) const {
+	uint32_t pos = 0;
+	for (const char *p = format; *p; p++) {
+		if (p[0] != '{' || p[1] != '}') {
+			out += *p;
+			continue;
+		}
+		p++;
+		if (pos >= size) {
+			out += "{}";
+			continue;
+		}
+		Tag tag = Tag(uint8_t(payload[pos++]));
+		switch (tag) {
+		case ARG_BOOL: {
+			bool value;
+			memcpy(&value, payload + pos, sizeof(value));
+			pos += sizeof(value);
+			out += value ? "true" : "false";
+			break;
+		}
+		case ARG_INT: {
+			int64_t value;
+			memcpy(&value, payload + pos, sizeof(value));
+			pos += sizeof(value);
+			out += to_string(value);
+			break;
+		}
+		case ARG_UINT: {
+			uint64_t value;
+			memcpy(&value, payload + pos, sizeof(value));
+			pos += sizeof(value);
+			out += to_string(value);
+			break;
+		}
+		case ARG_DOUBLE: {
+			double value;
+			memcpy(&value, payload + pos, sizeof(value));
+			pos += sizeof(value);
+			char text[32];
+			snprintf(text, sizeof(text), "%g", value);
+			out += text;
+			break;
+		}
+		case ARG_PRICE: {
+			int64_t ticks;
+			memcpy(&ticks, payload + pos, sizeof(ticks));
+			pos += sizeof(ticks);
+			append_price(out, ticks);
+			break;
+		}
+		case ARG_STRING: {
+			uint16_t length;
+			memcpy(&length, payload + pos, sizeof(length));
+			out.append(payload + pos + sizeof(length), length);
+			pos += uint32_t(sizeof(length) + length);
+			break;
+		}
+		}
+	}
+}
+
+Logger &Logger::instance() {
+	static Logger logger;
+	return logger;
+}
+
+Logger::Logger()
+	: min_level(LOG_INFO), orphan_dropped(0), output(stdout), owned_output(nullptr), flush_requested(false), stopping(false) {
+	writer = thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+	{
+		lock_guard<mutex> lock(rings_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	writer.join();
+	if (owned_output)
+		fclose(owned_output);
+}
+
+int64_t Logger::now() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//ThreadRing: the calling thread's ring; marks it orphaned when the thread exits so the writer can free it.
+struct ThreadRing {
+	shared_ptr<LogRing> ring;
+	~ThreadRing() {
+		if (ring)
+			ring->orphaned.store(true, memory_order_release);
+	}
+};
+
+//thread_ring(): Only a thread's first log call takes rings_mutex, to register its ring.
+LogRing &Logger::thread_ring() {
+	static thread_local ThreadRing local;
+	if (!local.ring) {
+		local.ring = make_shared<LogRing>();
+		lock_guard<mutex> lock(rings_mutex);
+		rings.push_back(local.ring);
+	}
+	return *local.ring;
+}
+
+void Logger::set_output(FILE *file) {
+	lock_guard<mutex> lock(output_mutex);
+	drain();
+	if (owned_output)
+		fclose(owned_output);
+	owned_output = nullptr;
+	output = file;
+}
+
+void Logger::open(const string &path) {
+	FILE *file = fopen(path.c_str(), "a");
+	if (!file)
+		throw RobinhoodException("Logger::open(): Could not open " + path);
+	lock_guard<mutex> lock(output_mutex);
+	drain();
+	if (owned_output)
+		fclose(owned_output);
+	owned_output = file;
+	output = file;
+}
+
+void Logger::flush() {
+	unique_lock<mutex> lock(rings_mutex);
+	vector<pair<shared_ptr<LogRing>, uint64_t>> targets;
+	for (auto &ring : rings)
+		targets.emplace_back(ring, ring->tail.load(memory_order_acquire));
+	flush_requested = true;
+	wake.notify_all();
+	drained.wait(lock, [&] {
+		for (auto &target : targets)
+			if (target.first->head.load(memory_order_acquire) < target.second)
+				return false;
+		return true;
+	});
+}
+
+uint64_t Logger::dropped() const {
+	lock_guard<mutex> lock(rings_mutex);
+	uint64_t total = orphan_dropped;
+	for (auto &ring : rings)
+		total += ring->dropped.load(memory_order_relaxed);
+	return total;
+}
+
+/* drain(): One pass over the rings.  Records are formatted, merged by time & written before
+   any ring's head moves, so flush() sees a record as consumed only once it reached the file.
+   rings_mutex is only taken to copy the ring list & to free rings, so threads registering a
+   ring, flush() & dropped() don't wait for the I/O.  Caller holds output_mutex.
+*/
+bool Logger::drain() {
+	vector<shared_ptr<LogRing>> current;
+	{
+		lock_guard<mutex> lock(rings_mutex);
+		current = rings;
+	}
+
+	vector<pair<int64_t, string>> lines;
+	vector<uint64_t> tails(current.size());
+	for (size_t i = 0; i < current.size(); i++) {
+		LogRing &ring = *current[i];
+		uint64_t head = ring.head.load(memory_order_relaxed);
+		tails[i] = ring.tail.load(memory_order_acquire);
+		for (uint64_t next = head; next < tails[i]; next++) {
+			const LogRecord &record = ring.records[next & (LogRing::capacity - 1)];
+			string line = format_timestamp(record.time);
+			line += ' ';
+			line += record.level < LOG_OFF ? levelNames[record.level] : "?";
+			line += ' ';
+			record.format_to(line);
+			line += '\n';
+			lines.emplace_back(record.time, std::move(line));
+		}
+	}
+	if (!lines.empty()) {
+		stable_sort(lines.begin(), lines.end(),
+			[](const pair<int64_t, string> &a, const pair<int64_t, string> &b) { return a.first < b.first; });
+		for (auto &line : lines)
+			fwrite(line.second.data(), 1, line.second.size(), output);
+		fflush(output);
+	}
+
+	for (size_t i = 0; i < current.size(); i++)
+		current[i]->head.store(tails[i], memory_order_release);
+
+	//Free the rings of exited threads once they are empty.
+	lock_guard<mutex> lock(rings_mutex);
+	for (size_t i = rings.size(); i-- > 0; ) {
+		LogRing &ring = *rings[i];
+		if (ring.orphaned.load(memory_order_acquire) && ring.head.load(memory_order_relaxed) == ring.tail.load(memory_order_acquire)) {
+			orphan_dropped += ring.dropped.load(memory_order_relaxed);
+			rings.erase(rings.begin() + i);
+		}
+	}
+	drained.notify_all();
+	return !lines.empty();
+}
+
+//run(): Writer thread. Polls the rings, backing off to 10ms while nothing is logged; flush() wakes it early.
+void Logger::run() {
+	chrono::milliseconds idle(1);
+	for (;;) {
+		bool wrote;
+		{
+			lock_guard<mutex> writing(output_mutex);
+			wrote = drain();
+		}
+		unique_lock<mutex> lock(rings_mutex);
+		if (stopping)
+			break;
+		if (wrote)
+			idle = chrono::milliseconds(1);
+		else if (!flush_requested) {
+			wake.wait_for(lock, idle, [this] { return stopping || flush_requested; });
+			idle = min(idle * 2, chrono::milliseconds(10));
+		}
+		flush_requested = false;
+	}
+	lock_guard<mutex> writing(output_mutex);
+	drain();
+}
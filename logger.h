@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <type_traits>
+#include "records.h"
+
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_OFF };
+
+/* LogRecord: one log call, with its arguments stored in binary.  Formatting into text happens on
+   the logger's thread.  Strings are copied (the caller's may not outlive the call) & truncated
+   once the record's payload is full.  format must be a string literal: only its pointer is kept.
+*/
+struct LogRecord {
+	static const std::size_t payloadSize = 480;
+	enum Tag : uint8_t { ARG_BOOL, ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_STRING, ARG_PRICE };
+
+	int64_t time;              //microseconds since epoch
+	const char *format;        //"{}" marks where the next argument goes
+	uint32_t level;
+	uint32_t size;             //payload bytes used
+	char payload[payloadSize];
+
+	void put(bool value) { put_scalar(ARG_BOOL, value); }
+	void put(const char *value) { put_string(value ? value : "(null)", value ? std::strlen(value) : 6); }
+	void put(const std::string &value) { put_string(value.data(), value.size()); }
+	void put(Price value) { put_scalar(ARG_PRICE, value.ticks); }
+	template <std::size_t N>
+	void put(const FixedString<N> &value) { put_string(value.data, std::strlen(value.data)); }
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+	put(T value) { put_scalar(ARG_INT, int64_t(value)); }
+	template <typename T>
+	typename std::enable_if<(std::is_integral<T>::value && !std::is_signed<T>::value) || std::is_enum<T>::value>::type
+	put(T value) { put_scalar(ARG_UINT, uint64_t(value)); }
+	template <typename T>
+	typename std::enable_if<std::is_floating_point<T>::value>::type
+	put(T value) { put_scalar(ARG_DOUBLE, double(value)); }
+
+	//format_to(): Append the formatted message (without time or level) to out.
+	void format_to(std::string &out) const;
+
+private:
+	template <typename T>
+	void put_scalar(Tag tag, T value) {
+		if (size + 1 + sizeof(T) > payloadSize)
+			return;
+		payload[size] = char(tag);
+		std::memcpy(payload + size + 1, &value, sizeof(T));
+		size += uint32_t(1 + sizeof(T));
+	}
+	void put_string(const char *text, std::size_t len);
+};
+
+/* LogRing: single producer, single consumer ring of LogRecords owned by one logging thread.
+   The thread fills records in place & publishes them by advancing tail; the logger's thread
+   consumes them by advancing head.  A full ring drops the record rather than wait.
+*/
+struct LogRing {
+	static const std::size_t capacity = 1024;    //power of two
+
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+	std::atomic<uint64_t> dropped;
+	std::atomic<bool> orphaned;                  //its thread has exited; freed once drained
+	std::unique_ptr<LogRecord[]> records;
+
+	LogRing() : head(0), tail(0), dropped(0), orphaned(false), records(new LogRecord[capacity]) {}
+};
+
+/* Logger: process wide asynchronous logger.  A log call checks the level, stamps the time &
+   copies its arguments into the calling thread's LogRing; no lock, allocation, formatting or
+   I/O happens on the caller's thread.  A background thread formats what the rings hold,
+   orders it by time & writes it in batches.  Use RH_LOG() so that arguments of disabled
+   levels are not even evaluated.
+*/
+class Logger {
+public:
+	static Logger &instance();
+	~Logger();
+
+	Logger(const Logger &) = delete;
+	Logger &operator=(const Logger &) = delete;
+
+	void set_level(LogLevel level) { min_level.store(level, std::memory_order_relaxed); }
+	LogLevel level() const { return LogLevel(min_level.load(std::memory_order_relaxed)); }
+	bool enabled(LogLevel level) const { return level >= min_level.load(std::memory_order_relaxed); }
+
+	//set_output(): Write to file (stdout by default) from now on. The file is not owned.
+	void set_output(FILE *file);
+	//open(): Append to the file at path from now on. Throws RobinhoodException if it can't be opened.
+	void open(const std::string &path);
+	//flush(): Block until everything logged before the call is written.
+	void flush();
+	//dropped(): Records lost to full rings since startup.
+	uint64_t dropped() const;
+
+	template <typename... Args>
+	void log(LogLevel level, const char *format, const Args &... args) {
+		LogRing &ring = thread_ring();
+		uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+		if (tail - ring.head.load(std::memory_order_acquire) >= LogRing::capacity) {
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		LogRecord &record = ring.records[tail & (LogRing::capacity - 1)];
+		record.time = now();
+		record.format = format;
+		record.level = level;
+		record.size = 0;
+		int expand[] = { 0, (record.put(args), 0)... };
+		(void)expand;
+		ring.tail.store(tail + 1, std::memory_order_release);
+	}
+
+private:
+	Logger();
+
+	LogRing &thread_ring();
+	static int64_t now();
+	void run();
+	//drain(): Format & write everything published so far. Returns false if there was nothing.
+	bool drain();
+
+	std::atomic<int> min_level;
+	mutable std::mutex rings_mutex;              //guards rings & the flags; log() takes it only to register a ring
+	std::vector<std::shared_ptr<LogRing>> rings;
+	uint64_t orphan_dropped;                     //dropped count of rings already freed
+	std::mutex output_mutex;                     //guards output & serialises drain(); held across formatting & I/O
+	FILE *output;
+	FILE *owned_output;                          //opened by open(), closed on replacement
+	std::condition_variable wake;
+	std::condition_variable drained;
+	bool flush_requested;
+	bool stopping;
+	std::thread writer;
+};
+
+//RH_LOG(): Log through Logger::instance() if level is enabled, e.g. RH_LOG(LOG_INFO, "order {} {}", id, state).
+#define RH_LOG(level, ...) \
+	do { \
+		Logger &rh_logger = Logger::instance(); \
+		if (rh_logger.enabled(level)) \
+			rh_logger.log(level, __VA_ARGS__); \
+	} while (0)
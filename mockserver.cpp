@@ -0,0 +1,481 @@
+/* mockserver.cpp: loopback stand-in for the Robinhood API */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#include "mockserver.h"
+#include "exceptions.h"
+#include "recordparser.h"
+
+using namespace std;
+
+#ifdef _WIN32
+static const mock_socket invalidSocket = INVALID_SOCKET;
+static void close_socket(mock_socket s) { closesocket(s); }
+#else
+static const mock_socket invalidSocket = -1;
+static void close_socket(mock_socket s) { ::close(s); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+static const char *status_text(int status) {
+	switch (status) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	default: return "Error";
+	}
+}
+
+static string url_decode(const string &text) {
+	string out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '+')
+			out += ' ';
+		else if (text[i] == '%' && i + 2 < text.size()) {
+			out += static_cast<char>(strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else
+			out += text[i];
+	}
+	return out;
+}
+
+//form_value(): Decoded value of key in a url-encoded form or query string.
+static string form_value(const string &form, const string &key) {
+	size_t start = 0;
+	while (start <= form.size()) {
+		size_t end = form.find('&', start);
+		if (end == string::npos)
+			end = form.size();
+		size_t equals = form.find('=', start);
+		if (equals != string::npos && equals < end && form.compare(start, equals - start, key) == 0)
+			return url_decode(form.substr(equals + 1, end - equals - 1));
+		start = end + 1;
+	}
+	return "";
+}
+
+//Orders listed per page; later pages are linked through "next" like the real API's cursor.
+static const size_t ordersPageSize = 100;
+
+//now_timestamp(): Current time in the API's format.
+static string now_timestamp() {
+	return format_timestamp(chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count());
+}
+
+//mock_id(): Stable UUID shaped id for a name.
+static string mock_id(const string &name, char variant) {
+	char id[40];
+	snprintf(id, sizeof(id), "00000000-0000-4000-%c000-%012llx", variant,
+			(unsigned long long)(hash<string>()(name) & 0xFFFFFFFFFFFFULL));
+	return id;
+}
+
+MockServer::MockServer(unsigned short port, chrono::microseconds latency, chrono::microseconds jitter)
+	: listener(invalidSocket), listen_port(port), running(false),
+	  latency_us(latency.count()), jitter_us(jitter.count()), requests(0), next_order(1) {
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		throw RobinhoodException("MockServer(): WSAStartup failed");
+#endif
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == invalidSocket)
+		throw RobinhoodException("MockServer(): Couldn't create socket");
+
+	int yes = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&yes), sizeof(yes));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0) {
+		close_socket(listener);
+		throw RobinhoodException("MockServer(): Couldn't listen on 127.0.0.1:" + to_string(port));
+	}
+
+	socklen_t length = sizeof(address);
+	getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+	listen_port = ntohs(address.sin_port);
+
+	running = true;
+	acceptor = thread(&MockServer::accept_loop, this);
+}
+
+MockServer::~MockServer() {
+	stop();
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+string MockServer::base_url() const {
+	return "http://127.0.0.1:" + to_string(listen_port);
+}
+
+void MockServer::set_latency(chrono::microseconds latency, chrono::microseconds jitter) {
+	latency_us.store(latency.count(), memory_order_relaxed);
+	jitter_us.store(jitter.count(), memory_order_relaxed);
+}
+
+void MockServer::stop() {
+	if (!running.exchange(false))
+		return;
+
+	//Wake the blocking accept() & recv() calls.
+#ifdef _WIN32
+	closesocket(listener);
+#else
+	shutdown(listener, SHUT_RDWR);
+	close_socket(listener);
+#endif
+	acceptor.join();
+
+	list<thread> threads;
+	{
+		lock_guard<mutex> lock(server_mutex);
+		for (mock_socket client : clients)
+			shutdown(client, 2);    //SHUT_RDWR / SD_BOTH
+		threads.swap(connections);
+	}
+	for (thread &connection : threads)
+		connection.join();
+}
+
+void MockServer::accept_loop() {
+	while (running) {
+		mock_socket client = accept(listener, nullptr, nullptr);
+		if (client == invalidSocket) {
+			if (!running)
+				return;
+			continue;
+		}
+		int yes = 1;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&yes), sizeof(yes));
+
+		list<thread> done;
+		{
+			lock_guard<mutex> lock(server_mutex);
+			if (!running) {
+				close_socket(client);
+				return;
+			}
+			clients.push_back(client);
+			connections.emplace_back(&MockServer::serve, this, client);
+
+			//Reap closed connections so churning clients don't pile up threads.
+			for (thread::id id : finished) {
+				auto it = find_if(connections.begin(), connections.end(), [id](const thread &t) { return t.get_id() == id; });
+				if (it != connections.end())
+					done.splice(done.end(), connections, it);
+			}
+			finished.clear();
+		}
+		for (thread &connection : done)
+			connection.join();
+	}
+}
+
+//serve(): Answer the requests of one keep-alive connection until the client closes it.
+void MockServer::serve(mock_socket client) {
+	static thread_local mt19937_64 random(hash<thread::id>()(this_thread::get_id()));
+	string buffer;
+	char chunk[16384];
+	bool open = true;
+
+	while (open && running) {
+		int received = recv(client, chunk, sizeof(chunk), 0);
+		if (received <= 0)
+			break;
+		buffer.append(chunk, received);
+
+		//Answer every complete request in the buffer.
+		for (;;) {
+			size_t headerEnd = buffer.find("\r\n\r\n");
+			if (headerEnd == string::npos)
+				break;
+
+			string head = buffer.substr(0, headerEnd);
+			string lowerHead(head);
+			transform(lowerHead.begin(), lowerHead.end(), lowerHead.begin(), ::tolower);
+
+			size_t bodyLength = 0;
+			size_t lengthField = lowerHead.find("\r\ncontent-length:");
+			if (lengthField != string::npos)
+				bodyLength = strtoul(head.c_str() + lengthField + 17, nullptr, 10);
+			if (buffer.size() < headerEnd + 4 + bodyLength)
+				break;
+			bool closeAfter = lowerHead.find("\r\nconnection: close") != string::npos;
+
+			size_t methodEnd = head.find(' ');
+			size_t targetEnd = head.find(' ', methodEnd + 1);
+			string method = head.substr(0, methodEnd);
+			string target = head.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+			string body = buffer.substr(headerEnd + 4, bodyLength);
+			buffer.erase(0, headerEnd + 4 + bodyLength);
+
+			requests.fetch_add(1, memory_order_relaxed);
+			Response response = route(method, target, body);
+
+			int64_t delay = latency_us.load(memory_order_relaxed);
+			int64_t jitter = jitter_us.load(memory_order_relaxed);
+			if (jitter > 0)
+				delay += static_cast<int64_t>(random() % static_cast<uint64_t>(jitter + 1));
+			if (delay > 0)
+				this_thread::sleep_for(chrono::microseconds(delay));
+
+			string reply = "HTTP/1.1 " + to_string(response.status) + " " + status_text(response.status) + "\r\n"
+				"Content-Type: application/json\r\n"
+				"Content-Length: " + to_string(response.body.size()) + "\r\n" +
+				(closeAfter ? "Connection: close\r\n" : "Connection: keep-alive\r\n") + "\r\n";
+			if (method != "HEAD")
+				reply += response.body;
+
+			for (size_t sent = 0; sent < reply.size();) {
+				int n = send(client, reply.data() + sent, static_cast<int>(reply.size() - sent), sendFlags);
+				if (n <= 0) {
+					open = false;
+					break;
+				}
+				sent += n;
+			}
+			if (closeAfter || !open) {
+				open = false;
+				break;
+			}
+		}
+	}
+
+	lock_guard<mutex> lock(server_mutex);
+	clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+	close_socket(client);
+	finished.push_back(this_thread::get_id());
+}
+
+json MockServer::quote(const string &symbol) {
+	//Deterministic price per symbol that moves a cent with every request.
+	uint64_t seed = hash<string>()(symbol);
+	int64_t cents = 1000 + static_cast<int64_t>(seed % 40000) + static_cast<int64_t>(requests.load(memory_order_relaxed) % 10);
+	char bid[24], ask[24], last[24];
+	snprintf(bid, sizeof(bid), "%lld.%02lld0000", (long long)(cents / 100), (long long)(cents % 100));
+	snprintf(ask, sizeof(ask), "%lld.%02lld0000", (long long)((cents + 1) / 100), (long long)((cents + 1) % 100));
+	snprintf(last, sizeof(last), "%lld.%02lld0000", (long long)(cents / 100), (long long)(cents % 100));
+	{
+		lock_guard<mutex> lock(server_mutex);
+		instrument_symbols[mock_id(symbol, 'a')] = symbol;
+	}
+
+	return json{
+		{ "ask_price", ask }, { "ask_size", 100 + seed % 900 },
+		{ "bid_price", bid }, { "bid_size", 100 + (seed >> 10) % 900 },
+		{ "last_trade_price", last }, { "last_extended_hours_trade_price", nullptr },
+		{ "previous_close", last }, { "adjusted_previous_close", last },
+		{ "previous_close_date", "2019-03-01" }, { "symbol", symbol },
+		{ "trading_halted", false }, { "has_traded", true },
+		{ "last_trade_price_source", "consolidated" }, { "updated_at", "2019-03-01T20:59:59Z" },
+		{ "instrument", base_url() + "/instruments/" + mock_id(symbol, 'a') + "/" }
+	};
+}
+
+json MockServer::order_ack(const string &body) {
+	lock_guard<mutex> lock(server_mutex);
+	string id = mock_id("order" + to_string(next_order++), '8');
+	string price = form_value(body, "price"), stop = form_value(body, "stop_price");
+	json order = {
+		{ "id", id },
+		{ "url", base_url() + "/orders/" + id + "/" },
+		{ "cancel", base_url() + "/orders/" + id + "/cancel/" },
+		{ "account", form_value(body, "account") },
+		{ "instrument", form_value(body, "instrument") },
+		{ "side", form_value(body, "side") },
+		{ "type", form_value(body, "type") },
+		{ "trigger", form_value(body, "trigger") },
+		{ "time_in_force", form_value(body, "time_in_force") },
+		{ "quantity", form_value(body, "quantity") },
+		{ "cumulative_quantity", "0.00000" },
+		{ "price", price.empty() ? json(nullptr) : json(price) },
+		{ "stop_price", stop.empty() ? json(nullptr) : json(stop) },
+		{ "average_price", nullptr },
+		{ "state", "confirmed" },
+		{ "executions", json::array() },
+		{ "created_at", now_timestamp() },
+		{ "updated_at", now_timestamp() }
+	};
+	orders[id] = order;
+	order_ids.push_back(id);
+	return order;
+}
+
+MockServer::Response MockServer::route(const string &method, const string &target, const string &body) {
+	size_t queryStart = target.find('?');
+	string path = target.substr(0, queryStart);
+	string query = queryStart == string::npos ? "" : target.substr(queryStart + 1);
+	auto starts = [&path](const char *prefix) { return path.compare(0, strlen(prefix), prefix) == 0; };
+	json notFound = { { "detail", "Not found." } };
+
+	if (method == "HEAD")
+		return Response{ 200, "" };
+
+	if (path == "/oauth2/token/" && method == "POST")
+		return Response{ 200, json{ { "access_token", "mock-access-token" }, { "refresh_token", "mock-refresh-token" },
+									{ "expires_in", 86400 }, { "token_type", "Bearer" }, { "scope", "internal" },
+									{ "mfa_code", form_value(body, "mfa_code") } }.dump() };
+
+	if (path == "/quotes/") {
+		json results = json::array();
+		string symbols = form_value(query, "symbols");
+		for (size_t start = 0; start < symbols.size();) {
+			size_t end = symbols.find(',', start);
+			if (end == string::npos)
+				end = symbols.size();
+			if (end > start)
+				results.push_back(quote(symbols.substr(start, end - start)));
+			start = end + 1;
+		}
+		return Response{ 200, json{ { "results", results } }.dump() };
+	}
+	if (starts("/quotes/")) {
+		string symbol = path.substr(8, path.size() - 9);
+		transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+		return Response{ 200, quote(symbol).dump() };
+	}
+
+	if (path == "/positions/") {
+		json position = {
+			{ "account", base_url() + "/accounts/MOCK0001/" },
+			{ "instrument", base_url() + "/instruments/" + mock_id("XLF", 'a') + "/" },
+			{ "quantity", "10.00000" }, { "average_buy_price", "26.0000" },
+			{ "shares_held_for_sells", "0.00000" }, { "updated_at", "2019-03-01T20:59:59.000000Z" }
+		};
+		return Response{ 200, json{ { "next", nullptr }, { "previous", nullptr }, { "results", json::array({ position }) } }.dump() };
+	}
+
+	if (starts("/accounts/")) {
+		json account = {
+			{ "url", base_url() + "/accounts/MOCK0001/" }, { "account_number", "MOCK0001" },
+			{ "buying_power", "25000.0000" }, { "cash", "25000.0000" },
+			{ "cash_held_for_orders", "0.0000" }, { "unsettled_funds", "0.0000" }, { "type", "margin" }
+		};
+		if (path == "/accounts/")
+			return Response{ 200, json{ { "next", nullptr }, { "previous", nullptr }, { "results", json::array({ account }) } }.dump() };
+		return Response{ 200, account.dump() };
+	}
+
+	if (path == "/instruments/") {
+		string symbol = form_value(query, "symbol");
+		json results = json::array();
+		if (!symbol.empty()) {
+			string id = mock_id(symbol, 'a');
+			results.push_back({ { "id", id }, { "url", base_url() + "/instruments/" + id + "/" }, { "symbol", symbol }, { "tradeable", true } });
+			lock_guard<mutex> lock(server_mutex);
+			instrument_symbols[id] = symbol;
+		}
+		return Response{ 200, json{ { "next", nullptr }, { "previous", nullptr }, { "results", std::move(results) } }.dump() };
+	}
+	if (starts("/instruments/")) {
+		string id = path.substr(13, path.size() - 14);
+		json instrument = { { "id", id }, { "url", base_url() + path }, { "tradeable", true } };
+		lock_guard<mutex> lock(server_mutex);
+		auto symbol = instrument_symbols.find(id);
+		if (symbol != instrument_symbols.end())
+			instrument["symbol"] = symbol->second;
+		else if (id == mock_id("XLF", 'a'))
+			instrument["symbol"] = "XLF";      //the mock's position
+		return Response{ 200, instrument.dump() };
+	}
+
+	if (path == "/orders/" && method == "POST") {
+		if (form_value(body, "quantity").empty() || form_value(body, "side").empty())
+			return Response{ 400, json{ { "detail", "quantity and side are required." } }.dump() };
+		return Response{ 201, order_ack(body).dump() };
+	}
+	if (path == "/orders/") {
+		string instrument = form_value(query, "instrument");
+		string since = form_value(query, "updated_at%5Bgte%5D");
+		if (since.empty())
+			since = form_value(query, "updated_at[gte]");
+		int64_t updatedSince = since.empty() ? 0 : parse_timestamp(since.data(), since.size());
+		string cursor = form_value(query, "cursor");
+		size_t skip = cursor.empty() ? 0 : strtoul(cursor.c_str(), nullptr, 10);
+
+		lock_guard<mutex> lock(server_mutex);
+		json results = json::array();
+		size_t matched = 0;
+		bool more = false;
+		//Newest first, filtered, one page from the cursor on.
+		for (auto it = order_ids.rbegin(); it != order_ids.rend(); ++it) {
+			const json &order = orders[*it];
+			if (!instrument.empty() && order["instrument"] != instrument)
+				continue;
+			if (updatedSince) {
+				string updated = order["updated_at"].get<string>();
+				if (parse_timestamp(updated.data(), updated.size()) < updatedSince)
+					continue;
+			}
+			if (matched++ < skip)
+				continue;
+			if (results.size() == ordersPageSize) {
+				more = true;
+				break;
+			}
+			results.push_back(order);
+		}
+		json next = nullptr;
+		if (more) {
+			//Keep the filters, move the cursor.
+			string link = base_url() + "/orders/?cursor=" + to_string(skip + ordersPageSize);
+			for (size_t start = 0; start < query.size();) {
+				size_t end = query.find('&', start);
+				if (end == string::npos)
+					end = query.size();
+				if (query.compare(start, 7, "cursor=") != 0)
+					link += "&" + query.substr(start, end - start);
+				start = end + 1;
+			}
+			next = link;
+		}
+		return Response{ 200, json{ { "previous", nullptr }, { "results", results }, { "next", next } }.dump() };
+	}
+	if (starts("/orders/")) {
+		size_t idEnd = path.find('/', 8);
+		string id = path.substr(8, idEnd == string::npos ? string::npos : idEnd - 8);
+		lock_guard<mutex> lock(server_mutex);
+		auto it = orders.find(id);
+		if (it == orders.end())
+			return Response{ 404, notFound.dump() };
+		if (idEnd != string::npos && path.compare(idEnd, string::npos, "/cancel/") == 0 && method == "POST") {
+			it->second["state"] = "cancelled";
+			it->second["cancel"] = nullptr;
+			it->second["updated_at"] = now_timestamp();
+			return Response{ 200, "{}" };
+		}
+		return Response{ 200, it->second.dump() };
+	}
+
+	return Response{ 404, notFound.dump() };
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+#ifdef _WIN32
+typedef std::uintptr_t mock_socket;    //SOCKET
+#else
+typedef int mock_socket;
+#endif
+
+/* MockServer: loopback HTTP/1.1 server standing in for the Robinhood API, for load tests &
+   benchmarks without a network.  Point a trader at it with TransportProfile::base_url =
+   server.base_url().  Serves canned but well formed responses:
+     POST /oauth2/token/              tokens for any credentials
+     GET  /quotes/SYM/, /quotes/?symbols=A,B
+     GET  /positions/, /accounts/, /instruments/ID/
+     POST /orders/                    confirmed order echoing the posted fields
+     GET  /orders/, /orders/ID/       POST /orders/ID/cancel/
+   Every response is delayed by latency plus a uniform random jitter.  Connections are kept
+   alive & served by one thread each.  Listens from construction until destruction.
+*/
+class MockServer {
+public:
+	//port 0 picks a free port.
+	explicit MockServer(unsigned short port = 0,
+						std::chrono::microseconds latency = std::chrono::microseconds(0),
+						std::chrono::microseconds jitter = std::chrono::microseconds(0));
+	~MockServer();
+
+	MockServer(const MockServer &) = delete;
+	MockServer &operator=(const MockServer &) = delete;
+
+	unsigned short port() const { return listen_port; }
+	//base_url(): "http://127.0.0.1:port"
+	std::string base_url() const;
+	void set_latency(std::chrono::microseconds latency, std::chrono::microseconds jitter);
+	uint64_t request_count() const { return requests.load(std::memory_order_relaxed); }
+	void stop();
+
+private:
+	struct Response {
+		int status;
+		std::string body;
+	};
+
+	void accept_loop();
+	void serve(mock_socket client);
+	Response route(const std::string &method, const std::string &target, const std::string &body);
+	json quote(const std::string &symbol);
+	json order_ack(const std::string &body);
+
+	mock_socket listener;
+	unsigned short listen_port;
+	std::atomic<bool> running;
+	std::atomic<int64_t> latency_us;
+	std::atomic<int64_t> jitter_us;
+	std::atomic<uint64_t> requests;
+	std::thread acceptor;
+
+	std::mutex server_mutex;
+	std::list<std::thread> connections;
+	std::vector<std::thread::id> finished;           //connections whose serve() returned, joined by accept_loop()
+	std::vector<mock_socket> clients;
+	std::unordered_map<std::string, json> orders;    //by id
+	std::vector<std::string> order_ids;              //in arrival order
+	std::unordered_map<std::string, std::string> instrument_symbols;    //instrument id -> symbol of quotes served
+	uint64_t next_order;
+};
@@ -0,0 +1,66 @@
+/* ordergateway.cpp: asynchronous order submission */
+
+#include <memory>
+#include <chrono>
+
+#include "ordergateway.h"
+#include "endpoints.h"
+#include "exceptions.h"
+#include "jsonstream.h"
+#include "recordparser.h"
+
+using namespace std;
+
+Order decode_order(const string &body) {
+	Order blank = Order();
+	blank.state = UNKNOWN_STATE;
+	RecordCollector<Order> collector(assign_order_field, blank, false);
+	JsonStreamParser parser(collector);
+	parser.feed(body.data(), body.size());
+	parser.finish();
+	if (collector.records.empty())
+		throw RobinhoodException("decode_order(): No order in response: " + body);
+	return collector.records[0];
+}
+
+OrderGateway::OrderGateway(HeaderList headers, const TransportProfile &profile, CURLSH *share, LatencyStats *stats)
+	: engine(headers, profile, share, stats) {
+}
+
+void OrderGateway::submit(const OrderTemplate &order, Callback callback) {
+	HttpRequest request{ HttpMethod::POST, orders_url, string(order.data(), order.size()) };
+
+	LatencyStats *stats = engine.latency_stats();
+
+	engine.submit(std::move(request), [callback, stats](HttpResponse &response) {
+		Order ack = Order();
+		exception_ptr error;
+		try {
+			if (response.result != CURLE_OK)
+				throw RobinhoodException("OrderGateway: order submission failed. Error Msg: " + string(curl_easy_strerror(response.result)));
+			if ((response.httpCode != 200) and (response.httpCode != 201))
+				throw RobinhoodException("OrderGateway: order rejected. Error Msg:" + response.body + "\nhttpCode: " + to_string(response.httpCode));
+			auto parseStart = chrono::steady_clock::now();
+			ack = decode_order(response.body);
+			if (stats)
+				stats->record_parse(orders_url, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - parseStart).count());
+		}
+		catch (...) {
+			error = current_exception();
+		}
+		callback(ack, error);
+	});
+}
+
+future<Order> OrderGateway::submit(const OrderTemplate &order) {
+	auto promise = make_shared<std::promise<Order>>();
+	auto result = promise->get_future();
+
+	submit(order, [promise](const Order &ack, exception_ptr error) {
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(ack);
+	});
+	return result;
+}
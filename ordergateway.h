@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <future>
+#include <functional>
+#include <exception>
+#include "requestengine.h"
+#include "ordertemplate.h"
+#include "records.h"
+
+/* OrderGateway: non-blocking order submission.  Orders are queued to a RequestEngine reserved
+   for orders, so its I/O thread never waits behind quote or account traffic.  The caller gets
+   the typed acknowledgement (id, state, cancel URL) through a future or a callback.
+*/
+class OrderGateway {
+public:
+	//Callback: runs on the gateway's I/O thread. error is null on success.
+	typedef std::function<void(const Order &ack, std::exception_ptr error)> Callback;
+
+	OrderGateway(HeaderList headers, const TransportProfile &profile = TransportProfile(), CURLSH *share = nullptr,
+				LatencyStats *stats = nullptr);
+
+	void set_headers(HeaderList headers) { engine.set_headers(headers); }
+	std::future<void> connect(const std::string &url) { return engine.connect(url); }
+
+	//submit(): Queue the body last built into order. The template can be rebuilt immediately.
+	std::future<Order> submit(const OrderTemplate &order);
+	void submit(const OrderTemplate &order, Callback callback);
+
+private:
+	RequestEngine engine;
+};
+
+//decode_order(): Typed order from a response body. Throws RobinhoodException on malformed JSON.
+Order decode_order(const std::string &body);
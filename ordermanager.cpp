@@ -0,0 +1,178 @@
+/* ordermanager.cpp: in-process table of our orders, advanced by acks & polled updates */
+
+#include "ordermanager.h"
+
+using namespace std;
+
+//progress(): How far along its life an order state is; states never go back.
+static int progress(OrderState state) {
+	switch (state) {
+	case QUEUED:
+	case UNCONFIRMED:
+		return 0;
+	case CONFIRMED:
+		return 1;
+	case PARTIALLY_FILLED:
+		return 2;
+	case UNKNOWN_STATE:
+		return -1;
+	default:
+		return 3;
+	}
+}
+
+OrderManager::OrderManager() : listeners(make_shared<vector<Listener>>()) {
+}
+
+//add_working(): Add (sign 1) or remove (sign -1) a working order to the indexes & totals.
+void OrderManager::add_working(const Order &order, int sign) {
+	if (!working(order.state))
+		return;
+	int64_t unfilled = order.quantity.ticks - order.cumulative_quantity.ticks;
+	if (unfilled < 0)
+		unfilled = 0;
+
+	Book *targets[] = { &all, order.symbol ? &books[order.symbol] : nullptr };
+	for (Book *book : targets) {
+		if (!book)
+			continue;
+		if (sign > 0)
+			book->open.insert(order.id.data);
+		else
+			book->open.erase(order.id.data);
+		book->working[order.side] += sign * unfilled;
+	}
+	if (sign < 0 && order.symbol && books[order.symbol].open.empty())
+		books.erase(order.symbol);
+}
+
+bool OrderManager::update(const Order &order, bool submitted) {
+	if (order.id.empty())
+		return false;
+
+	Order previous = Order();
+	previous.state = UNKNOWN_STATE;
+	Order current;
+	shared_ptr<const vector<Listener>> notify;
+	{
+		lock_guard<mutex> lock(orders_mutex);
+		auto found = orders.find(order.id.data);
+		if (found == orders.end()) {
+			Order &stored = orders[order.id.data] = order;
+			add_working(stored, 1);
+			current = stored;
+			if (!submitted) {
+				previous.cumulative_quantity = order.cumulative_quantity;
+				previous.average_price = order.average_price;
+			}
+		}
+		else {
+			Order &stored = found->second;
+			//Stale or repeated: an older poll, or nothing new since the last one.
+			if (order.updated_at < stored.updated_at || progress(order.state) < progress(stored.state)
+				|| order.cumulative_quantity < stored.cumulative_quantity)
+				return false;
+			if (order.updated_at == stored.updated_at && order.state == stored.state
+				&& order.cumulative_quantity == stored.cumulative_quantity && order.average_price == stored.average_price
+				&& strcmp(order.cancel_url.data, stored.cancel_url.data) == 0)
+				return false;
+
+			previous = stored;
+			add_working(stored, -1);
+			stored = order;
+			//Polled orders may lack what the ack resolved.
+			if (!stored.symbol)
+				stored.symbol = previous.symbol;
+			if (stored.instrument.empty())
+				stored.instrument = previous.instrument;
+			add_working(stored, 1);
+			current = stored;
+		}
+		notify = listeners;
+	}
+	for (const Listener &listener : *notify)
+		listener(previous, current);
+	return true;
+}
+
+size_t OrderManager::apply(const vector<Order> &updates) {
+	size_t changed = 0;
+	for (const Order &order : updates)
+		if (apply(order))
+			changed++;
+	return changed;
+}
+
+bool OrderManager::find(const string &orderId, Order &order) const {
+	lock_guard<mutex> lock(orders_mutex);
+	auto found = orders.find(orderId);
+	if (found == orders.end())
+		return false;
+	order = found->second;
+	return true;
+}
+
+vector<Order> OrderManager::open_orders(SymbolId symbol) const {
+	vector<Order> result;
+	lock_guard<mutex> lock(orders_mutex);
+	const Book *book = &all;
+	if (symbol) {
+		auto found = books.find(symbol);
+		if (found == books.end())
+			return result;
+		book = &found->second;
+	}
+	result.reserve(book->open.size());
+	for (const string &id : book->open)
+		result.push_back(orders.at(id));
+	return result;
+}
+
+size_t OrderManager::open_count(SymbolId symbol) const {
+	lock_guard<mutex> lock(orders_mutex);
+	if (!symbol)
+		return all.open.size();
+	auto found = books.find(symbol);
+	return found == books.end() ? 0 : found->second.open.size();
+}
+
+Price OrderManager::working_quantity(Side side, SymbolId symbol) const {
+	lock_guard<mutex> lock(orders_mutex);
+	if (!symbol)
+		return Price{ all.working[side] };
+	auto found = books.find(symbol);
+	return Price{ found == books.end() ? 0 : found->second.working[side] };
+}
+
+size_t OrderManager::size() const {
+	lock_guard<mutex> lock(orders_mutex);
+	return orders.size();
+}
+
+void OrderManager::add_listener(Listener listener) {
+	lock_guard<mutex> lock(orders_mutex);
+	auto added = make_shared<vector<Listener>>(*listeners);
+	added->push_back(listener);
+	listeners = added;
+}
+
+size_t OrderManager::prune(int64_t before) {
+	lock_guard<mutex> lock(orders_mutex);
+	size_t removed = 0;
+	for (auto it = orders.begin(); it != orders.end(); ) {
+		if (!working(it->second.state) && it->second.updated_at < before) {
+			it = orders.erase(it);
+			removed++;
+		}
+		else
+			++it;
+	}
+	return removed;
+}
+
+void OrderManager::clear() {
+	lock_guard<mutex> lock(orders_mutex);
+	orders.clear();
+	books.clear();
+	all = Book();
+}
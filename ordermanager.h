@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include "records.h"
+
+/* OrderManager: our own orders as submitted & as last seen by polling.  Orders are indexed by id
+   & working ones also by symbol, each symbol keeping running totals of its unfilled buy & sell
+   shares, so "open orders of XLF" or "working quantity" are hash lookups instead of scans of
+   get_orders().  States only move forward (queued/unconfirmed -> confirmed -> partially filled
+   -> filled/cancelled/rejected/failed) & updates older than what is known are ignored, so polls
+   may repeat or overlap.  Thread safe.
+*/
+class OrderManager {
+public:
+	//Listener: an order changed; previous has state UNKNOWN_STATE if the order is new.  Orders adopted
+	//by apply() were filled before we knew them, so their previous already has their cumulative_quantity
+	//& average_price. Runs on the updating thread after the manager's lock is released.
+	typedef std::function<void(const Order &previous, const Order &current)> Listener;
+
+	OrderManager();
+
+	OrderManager(const OrderManager &) = delete;
+	OrderManager &operator=(const OrderManager &) = delete;
+
+	//record(): A submitted order's acknowledgement.
+	void record(const Order &ack) { update(ack, true); }
+	//apply(): An order as polled; orders placed elsewhere are adopted. Returns false if nothing changed.
+	bool apply(const Order &order) { return update(order, false); }
+	//apply(): Returns the number of orders that changed.
+	std::size_t apply(const std::vector<Order> &orders);
+
+	bool find(const std::string &orderId, Order &order) const;
+	//open_orders(): Working orders of symbol, or of every symbol if 0.
+	std::vector<Order> open_orders(SymbolId symbol = 0) const;
+	std::size_t open_count(SymbolId symbol = 0) const;
+	//working_quantity(): Unfilled shares of the working side orders of symbol, or of every symbol if 0.
+	Price working_quantity(Side side, SymbolId symbol = 0) const;
+	//size(): Orders known, working or not.
+	std::size_t size() const;
+
+	//add_listener(): Listeners are called in the order they were added.
+	void add_listener(Listener listener);
+	//prune(): Forget orders that stopped working before time (microseconds since epoch). Returns the number removed.
+	std::size_t prune(int64_t before);
+	void clear();
+
+	static bool working(OrderState state) { return state <= PARTIALLY_FILLED; }
+
+private:
+	//Book: the working orders of one symbol.
+	struct Book {
+		std::unordered_set<std::string> open;
+		int64_t working[2] = { 0, 0 };         //unfilled ticks by Side
+	};
+
+	bool update(const Order &order, bool submitted);
+	void add_working(const Order &order, int sign);
+
+	mutable std::mutex orders_mutex;
+	std::unordered_map<std::string, Order> orders;
+	std::unordered_map<SymbolId, Book> books;
+	Book all;                                  //every symbol's working orders
+	std::shared_ptr<const std::vector<Listener>> listeners;   //replaced, never changed, so apply() can call them unlocked
+};
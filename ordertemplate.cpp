@@ -0,0 +1,120 @@
+/* ordertemplate.cpp: pre-encoded order post bodies */
+
+#include <algorithm>
+#include <cstring>
+#include <curl/curl.h>
+
+#include "ordertemplate.h"
+#include "exceptions.h"
+
+using namespace std;
+
+//Room for "&price=", "&stop_price=" & "&quantity=" with their values.
+const size_t variableFieldsSize = 96;
+
+//url_encode(): Form-encode a value (the account & instrument URLs contain ':' and '/').
+static string url_encode(const string &value) {
+	char *escaped = curl_easy_escape(nullptr, value.c_str(), static_cast<int>(value.size()));
+	if (!escaped)
+		throw RobinhoodException("OrderTemplate(): Could not url-encode " + value);
+	string result(escaped);
+	curl_free(escaped);
+	return result;
+}
+
+//format_uint(): Writes value in decimal. Returns the length.
+static size_t format_uint(uint64_t value, char *out) {
+	char digits[20];
+	size_t count = 0;
+	do {
+		digits[count++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value);
+	for (size_t i = 0; i < count; i++)
+		out[i] = digits[count - 1 - i];
+	return count;
+}
+
+size_t format_price(Price price, char *out) {
+	size_t len = 0;
+	uint64_t ticks = price.ticks < 0 ? uint64_t(-price.ticks) : uint64_t(price.ticks);
+	if (price.ticks < 0)
+		out[len++] = '-';
+
+	len += format_uint(ticks / price_scale, out + len);
+
+	uint64_t fraction = ticks % price_scale;
+	if (fraction) {
+		out[len++] = '.';
+		for (uint64_t unit = price_scale / 10; unit && fraction; unit /= 10) {
+			out[len++] = static_cast<char>('0' + fraction / unit);
+			fraction %= unit;
+		}
+	}
+	return len;
+}
+
+OrderTemplate::OrderTemplate(
+	const string &account_url,
+	const string &instrument_url,
+	const string &symbol,
+	Side side,
+	OrderType order_type,
+	TimeInForce time_in_force,
+	Trigger trigger)
+	: order_symbol(symbol), order_side(side), type(order_type), order_trigger(trigger),
+	  order_time_in_force(time_in_force), built_quantity(0), built_price(Price()), built_stop_price(Price()) {
+
+	std::transform(order_symbol.begin(), order_symbol.end(), order_symbol.begin(), ::toupper);
+
+	string prefix = "instrument=" + url_encode(instrument_url);
+	if (!order_symbol.empty())
+		prefix += "&symbol=" + order_symbol;
+	prefix += order_type == OrderType::MARKET ? "&type=market" : "&type=limit";
+	prefix += side == Side::BUY ? "&side=buy" : "&side=sell";
+	prefix += time_in_force == TimeInForce::GTC ? "&time_in_force=gtc" : "&time_in_force=gfd";
+	prefix += trigger == Trigger::STOP ? "&trigger=stop" : "&trigger=immediate";
+	prefix += "&account=" + url_encode(account_url);
+
+	buffer.assign(prefix.size() + variableFieldsSize, '\0');
+	memcpy(buffer.data(), prefix.data(), prefix.size());
+	prefix_length = length = prefix.size();
+}
+
+//append(): Copy a literal field name into the buffer.
+template <size_t N>
+static inline size_t append(char *out, const char (&literal)[N]) {
+	memcpy(out, literal, N - 1);
+	return N - 1;
+}
+
+void OrderTemplate::build(int quantity, Price price, Price stop_price) {
+	if (quantity <= 0)
+		throw RobinhoodException("OrderTemplate::build(): Quantity must be positive number");
+	if (type == OrderType::LIMIT && price.ticks <= 0)
+		throw RobinhoodException("OrderTemplate::build(): limit price must be greater than 0");
+	if (type == OrderType::MARKET && price.ticks > 0)
+		throw RobinhoodException("OrderTemplate::build(): Market order has limit price");
+	if (order_trigger == Trigger::STOP && stop_price.ticks <= 0)
+		throw RobinhoodException("OrderTemplate::build(): Stop_price must be greater than 0");
+	if (order_trigger != Trigger::STOP && stop_price.ticks > 0)
+		throw RobinhoodException("OrderTemplate::build(): Stop price set for non-stop order");
+
+	char *out = buffer.data() + prefix_length;
+	if (stop_price.ticks > 0) {
+		out += append(out, "&stop_price=");
+		out += format_price(stop_price, out);
+	}
+	if (price.ticks > 0) {
+		out += append(out, "&price=");
+		out += format_price(price, out);
+	}
+	out += append(out, "&quantity=");
+	out += format_uint(static_cast<uint64_t>(quantity), out);
+	*out = '\0';
+
+	length = out - buffer.data();
+	built_quantity = quantity;
+	built_price = price;
+	built_stop_price = stop_price;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "records.h"
+
+/* OrderTemplate: post body of an order with the constant fields (instrument, symbol, type, side,
+   time_in_force, trigger, account) url-encoded once.  build() appends quantity, price & stop
+   price into a buffer reserved up front, so repeated orders on the same instrument don't
+   allocate.
+*/
+class OrderTemplate {
+public:
+	OrderTemplate(const std::string &account_url,
+				const std::string &instrument_url,
+				const std::string &symbol,
+				Side side,
+				OrderType order_type,
+				TimeInForce time_in_force,
+				Trigger trigger);
+
+	//build(): Fill in the variable fields. A zero price/stop_price is left out. Throws RobinhoodException on invalid values.
+	void build(int quantity, Price price, Price stop_price);
+
+	//Post body from the last build(); valid until the next one.
+	const char *data() const { return buffer.data(); }
+	std::size_t size() const { return length; }
+
+	const std::string &symbol() const { return order_symbol; }
+	Side side() const { return order_side; }
+	OrderType order_type() const { return type; }
+	Trigger trigger() const { return order_trigger; }
+	TimeInForce time_in_force() const { return order_time_in_force; }
+	//Variable fields of the last build().
+	int quantity() const { return built_quantity; }
+	Price price() const { return built_price; }
+	Price stop_price() const { return built_stop_price; }
+
+private:
+	std::vector<char> buffer;
+	std::size_t prefix_length;
+	std::size_t length;
+	std::string order_symbol;
+	Side order_side;
+	OrderType type;
+	Trigger order_trigger;
+	TimeInForce order_time_in_force;
+	int built_quantity;
+	Price built_price;
+	Price built_stop_price;
+};
+
+//format_price(): Writes price as a decimal without trailing zeros ("26.78"). Returns the length; out needs 24 chars.
+std::size_t format_price(Price price, char *out);
@@ -0,0 +1,338 @@
+/* paperexchange.cpp: simulated order matching, positions & account */
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+
+#include "paperexchange.h"
+#include "endpoints.h"
+
+using namespace std;
+
+//notional(): Cash value of quantity shares at price, both fixed-point, without overflowing the product.
+static int64_t notional(int64_t quantity, Price price) {
+	return (quantity / price_scale) * price.ticks + (quantity % price_scale) * price.ticks / price_scale;
+}
+
+PaperExchange::PaperExchange(Price cash)
+	: balance(), clock(0), fills(0) {
+	balance.account_number.assign("PAPER");
+	balance.cash = cash;
+	balance.buying_power = cash;
+}
+
+int64_t PaperExchange::now() const {
+	if (clock)
+		return clock;
+	return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool PaperExchange::working(const Order &order) const {
+	return order.state == CONFIRMED || order.state == PARTIALLY_FILLED;
+}
+
+Order PaperExchange::submit(SymbolId symbol, Side side, OrderType type, Trigger trigger, TimeInForce time_in_force,
+							int quantity, Price price, Price stop_price) {
+	lock_guard<mutex> lock(exchange_mutex);
+
+	size_t index = order_log.size();
+	Order order = Order();
+	char id[40];
+	snprintf(id, sizeof(id), "00000000-0000-4000-8000-%012llx", (unsigned long long)index + 1);
+	order.id.assign(id, strlen(id));
+	order.symbol = symbol;
+	order.side = side;
+	order.type = type;
+	order.trigger = trigger;
+	order.time_in_force = time_in_force;
+	order.state = CONFIRMED;
+	order.quantity.ticks = int64_t(quantity) * price_scale;
+	order.price = price;
+	order.stop_price = stop_price;
+	order.created_at = order.updated_at = now();
+	order.cancel_url.assign(orders_url + id + "/cancel/");
+
+	Book &book = books[symbol];
+	auto holding = holdings.find(symbol);
+
+	//Risk checks: the same rules the order methods validate, plus cash & shares.
+	bool valid = symbol != 0 && quantity > 0 &&
+				(type == MARKET ? price.ticks == 0 : price.ticks > 0) &&
+				(trigger == STOP ? stop_price.ticks > 0 : stop_price.ticks == 0);
+	Price reserve = Price();
+	if (valid && side == BUY) {
+		reserve = type == LIMIT ? price : trigger == STOP ? stop_price : book.quote.ask_price;
+		//No ask (no quote yet, halted, pre-market): hold cash at the last trade, or reject.
+		if (reserve.ticks <= 0)
+			reserve = book.quote.last_trade_price;
+		valid = reserve.ticks > 0 && notional(order.quantity.ticks, reserve) <= balance.cash.ticks - balance.cash_held_for_orders.ticks;
+	}
+	else if (valid)
+		valid = holding != holdings.end() && order.quantity.ticks <= holding->second.quantity.ticks - holding->second.shares_held_for_sells.ticks;
+
+	if (!valid) {
+		order.state = REJECTED;
+		order.cancel_url.clear();
+	}
+	order_log.push_back(order);
+	reserve_price.push_back(reserve);
+	order_index.emplace(order.id.data, index);
+	if (!valid)
+		return order;
+
+	if (side == BUY)
+		balance.cash_held_for_orders.ticks += notional(order.quantity.ticks, reserve);
+	else
+		holding->second.shares_held_for_sells.ticks += order.quantity.ticks;
+	working_orders.insert(index);
+
+	if (trigger == STOP) {
+		if (side == BUY)
+			book.buy_stops.emplace(stop_price.ticks, index);
+		else
+			book.sell_stops.emplace(stop_price.ticks, index);
+	}
+	else
+		activate(book, index);
+
+	match(book);
+	return order_log[index];
+}
+
+//activate(): Put an order (or a triggered stop) in the book as the market or limit order it is.
+void PaperExchange::activate(Book &book, size_t index) {
+	const Order &order = order_log[index];
+	if (order.type == MARKET)
+		book.market.push_back(index);
+	else if (order.side == BUY)
+		book.bids.emplace(order.price.ticks, index);
+	else
+		book.asks.emplace(order.price.ticks, index);
+}
+
+void PaperExchange::on_quote(const Quote &quote) {
+	if (quote.symbol == 0)
+		return;
+	lock_guard<mutex> lock(exchange_mutex);
+	Book &book = books[quote.symbol];
+	book.quote = quote;
+	book.quoted = true;
+	if (quote.updated_at > clock)
+		clock = quote.updated_at;
+	match(book);
+}
+
+bool PaperExchange::has_quote(SymbolId symbol) const {
+	lock_guard<mutex> lock(exchange_mutex);
+	auto it = books.find(symbol);
+	return it != books.end() && it->second.quoted;
+}
+
+/* match(): Trigger stops, then fill market & limit orders against the book's quote.  Orders
+   that stopped working are dropped from the book here rather than when cancelled.
+*/
+void PaperExchange::match(Book &book) {
+	if (!book.quoted || book.quote.trading_halted)
+		return;
+	const Price ask = book.quote.ask_price, bid = book.quote.bid_price;
+	const int64_t unlimited = numeric_limits<int64_t>::max();
+	int64_t askAvailable = book.quote.ask_size ? int64_t(book.quote.ask_size) * price_scale : unlimited;
+	int64_t bidAvailable = book.quote.bid_size ? int64_t(book.quote.bid_size) * price_scale : unlimited;
+
+	while (ask.ticks > 0 && !book.buy_stops.empty() && book.buy_stops.begin()->first <= ask.ticks) {
+		size_t index = book.buy_stops.begin()->second;
+		book.buy_stops.erase(book.buy_stops.begin());
+		if (working(order_log[index]))
+			activate(book, index);
+	}
+	while (bid.ticks > 0 && !book.sell_stops.empty() && book.sell_stops.begin()->first >= bid.ticks) {
+		size_t index = book.sell_stops.begin()->second;
+		book.sell_stops.erase(book.sell_stops.begin());
+		if (working(order_log[index]))
+			activate(book, index);
+	}
+
+	if (!book.market.empty()) {
+		deque<size_t> waiting;
+		for (size_t index : book.market) {
+			if (!working(order_log[index]))
+				continue;
+			bool buy = order_log[index].side == BUY;
+			Price price = buy ? ask : bid;
+			int64_t &available = buy ? askAvailable : bidAvailable;
+			if (price.ticks > 0 && available > 0) {
+				if (buy && price.ticks > reserve_price[index].ticks && !reprice(index, price))
+					continue;
+				int64_t quantity = std::min(remaining(order_log[index]), available);
+				available -= quantity;
+				fill(index, price, quantity);
+			}
+			if (working(order_log[index]))
+				waiting.push_back(index);
+		}
+		book.market.swap(waiting);
+	}
+
+	while (ask.ticks > 0 && askAvailable > 0 && !book.bids.empty() && book.bids.begin()->first >= ask.ticks) {
+		size_t index = book.bids.begin()->second;
+		if (working(order_log[index])) {
+			int64_t quantity = std::min(remaining(order_log[index]), askAvailable);
+			askAvailable -= quantity;
+			fill(index, ask, quantity);
+		}
+		if (!working(order_log[index]))
+			book.bids.erase(book.bids.begin());
+	}
+	while (bid.ticks > 0 && bidAvailable > 0 && !book.asks.empty() && book.asks.begin()->first <= bid.ticks) {
+		size_t index = book.asks.begin()->second;
+		if (working(order_log[index])) {
+			int64_t quantity = std::min(remaining(order_log[index]), bidAvailable);
+			bidAvailable -= quantity;
+			fill(index, bid, quantity);
+		}
+		if (!working(order_log[index]))
+			book.asks.erase(book.asks.begin());
+	}
+}
+
+//fill(): Execute quantity (fixed-point shares) of an order at price.
+void PaperExchange::fill(size_t index, Price price, int64_t quantity) {
+	Order &order = order_log[index];
+	Position &holding = holdings[order.symbol];
+	holding.symbol = order.symbol;
+
+	int64_t filled = order.cumulative_quantity.ticks;
+	order.average_price.ticks = (notional(filled, order.average_price) + notional(quantity, price)) * price_scale / (filled + quantity);
+	order.cumulative_quantity.ticks = filled + quantity;
+	order.updated_at = now();
+
+	if (order.side == BUY) {
+		int64_t held = holding.quantity.ticks;
+		holding.average_buy_price.ticks = (notional(held, holding.average_buy_price) + notional(quantity, price)) * price_scale / (held + quantity);
+		holding.quantity.ticks = held + quantity;
+		balance.cash.ticks -= notional(quantity, price);
+		balance.cash_held_for_orders.ticks -= notional(quantity, reserve_price[index]);
+	}
+	else {
+		holding.quantity.ticks -= quantity;
+		holding.shares_held_for_sells.ticks -= quantity;
+		if (holding.quantity.ticks == 0)
+			holding.average_buy_price = Price();
+		balance.cash.ticks += notional(quantity, price);
+	}
+	holding.updated_at = order.updated_at;
+	fills++;
+
+	if (remaining(order) == 0)
+		finish(index, FILLED);
+	else
+		order.state = PARTIALLY_FILLED;
+}
+
+//release(): Give back the cash or shares held for the unfilled part of an order.
+void PaperExchange::release(size_t index) {
+	const Order &order = order_log[index];
+	if (order.side == BUY)
+		balance.cash_held_for_orders.ticks -= notional(remaining(order), reserve_price[index]);
+	else
+		holdings[order.symbol].shares_held_for_sells.ticks -= remaining(order);
+}
+
+//reprice(): Hold cash for the rest of a buy at price instead. Cancels it & returns false if buying power can't cover that.
+bool PaperExchange::reprice(size_t index, Price price) {
+	const Order &order = order_log[index];
+	int64_t extra = notional(remaining(order), price) - notional(remaining(order), reserve_price[index]);
+	if (extra > balance.cash.ticks - balance.cash_held_for_orders.ticks) {
+		release(index);
+		finish(index, CANCELLED);
+		return false;
+	}
+	balance.cash_held_for_orders.ticks += extra;
+	reserve_price[index] = price;
+	return true;
+}
+
+void PaperExchange::finish(size_t index, OrderState state) {
+	Order &order = order_log[index];
+	order.state = state;
+	order.cancel_url.clear();
+	order.updated_at = now();
+	working_orders.erase(index);
+}
+
+bool PaperExchange::cancel(const string &orderId) {
+	lock_guard<mutex> lock(exchange_mutex);
+	auto it = order_index.find(orderId);
+	if (it == order_index.end() || !working(order_log[it->second]))
+		return false;
+	release(it->second);
+	finish(it->second, CANCELLED);
+	return true;
+}
+
+size_t PaperExchange::cancel_all(SymbolId symbol) {
+	lock_guard<mutex> lock(exchange_mutex);
+	vector<size_t> cancels;
+	for (size_t index : working_orders)
+		if (symbol == 0 || order_log[index].symbol == symbol)
+			cancels.push_back(index);
+	for (size_t index : cancels) {
+		release(index);
+		finish(index, CANCELLED);
+	}
+	return cancels.size();
+}
+
+size_t PaperExchange::end_of_day() {
+	lock_guard<mutex> lock(exchange_mutex);
+	vector<size_t> expired;
+	for (size_t index : working_orders)
+		if (order_log[index].time_in_force == GFD)
+			expired.push_back(index);
+	for (size_t index : expired) {
+		release(index);
+		finish(index, CANCELLED);
+	}
+	return expired.size();
+}
+
+bool PaperExchange::find_order(const string &orderId, Order &order) const {
+	lock_guard<mutex> lock(exchange_mutex);
+	auto it = order_index.find(orderId);
+	if (it == order_index.end())
+		return false;
+	order = order_log[it->second];
+	return true;
+}
+
+vector<Order> PaperExchange::orders(SymbolId symbol) const {
+	lock_guard<mutex> lock(exchange_mutex);
+	vector<Order> result;
+	for (auto it = order_log.rbegin(); it != order_log.rend(); ++it)
+		if (symbol == 0 || it->symbol == symbol)
+			result.push_back(*it);
+	return result;
+}
+
+vector<Position> PaperExchange::positions(bool nonzero) const {
+	lock_guard<mutex> lock(exchange_mutex);
+	vector<Position> result;
+	for (auto &holding : holdings)
+		if (!nonzero || holding.second.quantity.ticks != 0)
+			result.push_back(holding.second);
+	sort(result.begin(), result.end(), [](const Position &a, const Position &b) { return a.symbol < b.symbol; });
+	return result;
+}
+
+Account PaperExchange::account() const {
+	lock_guard<mutex> lock(exchange_mutex);
+	Account account = balance;
+	account.buying_power.ticks = balance.cash.ticks - balance.cash_held_for_orders.ticks;
+	return account;
+}
+
+uint64_t PaperExchange::fill_count() const {
+	lock_guard<mutex> lock(exchange_mutex);
+	return fills;
+}
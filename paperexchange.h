@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include "records.h"
+
+/* PaperExchange: simulated execution against the quotes it is shown.  Each symbol has a book of
+   working orders matched on every on_quote():
+     market          fills at the ask (buy) or bid (sell)
+     limit           fills at the ask/bid once it is at or through the limit
+     stop, stop-limit become market/limit orders once the ask (buy) or bid (sell) reaches the stop
+   Fills take at most the displayed size of each quote (all of it if no size is shown), in
+   price then time priority, so orders can fill partially.  Buys must be covered by buying
+   power & sells by shares held; others are rejected.  A market buy filling above the cash held
+   for it (a stop gapping through, an ask that moved) is cancelled unless buying power covers the
+   difference.  No shorting, fees or settlement delay.
+   Thread safe.
+*/
+class PaperExchange {
+public:
+	explicit PaperExchange(Price cash = Price::from_double(100000));
+
+	PaperExchange(const PaperExchange &) = delete;
+	PaperExchange &operator=(const PaperExchange &) = delete;
+
+	//submit(): Accept an order & match it against the book's last quote. Returns the order as it stands.
+	Order submit(SymbolId symbol, Side side, OrderType type, Trigger trigger, TimeInForce time_in_force,
+				int quantity, Price price, Price stop_price);
+	//cancel(): Returns false if the order is unknown or no longer working.
+	bool cancel(const std::string &orderId);
+	//cancel_all(): Cancel the working orders of symbol, or all of them. Returns the number cancelled.
+	std::size_t cancel_all(SymbolId symbol = 0);
+	//end_of_day(): Expire working good-for-day orders.
+	std::size_t end_of_day();
+
+	void on_quote(const Quote &quote);
+	bool has_quote(SymbolId symbol) const;
+
+	bool find_order(const std::string &orderId, Order &order) const;
+	//orders(): Every order of symbol (or all), newest first as the orders endpoint lists them.
+	std::vector<Order> orders(SymbolId symbol = 0) const;
+	std::vector<Position> positions(bool nonzero = false) const;
+	Account account() const;
+	uint64_t fill_count() const;
+
+private:
+	struct Book {
+		Quote quote = {};
+		bool quoted = false;
+		std::multimap<int64_t, std::size_t, std::greater<int64_t>> bids;         //buy limits, highest first
+		std::multimap<int64_t, std::size_t> asks;                                //sell limits, lowest first
+		std::multimap<int64_t, std::size_t> buy_stops;                           //lowest stop first
+		std::multimap<int64_t, std::size_t, std::greater<int64_t>> sell_stops;   //highest stop first
+		std::deque<std::size_t> market;                                          //market orders in arrival order
+	};
+
+	int64_t now() const;
+	bool working(const Order &order) const;
+	void activate(Book &book, std::size_t index);
+	void match(Book &book);
+	void fill(std::size_t index, Price price, int64_t quantity);
+	void finish(std::size_t index, OrderState state);
+	void release(std::size_t index);
+	bool reprice(std::size_t index, Price price);
+	int64_t remaining(const Order &order) const { return order.quantity.ticks - order.cumulative_quantity.ticks; }
+
+	mutable std::mutex exchange_mutex;
+	std::vector<Order> order_log;                     //indexed by arrival
+	std::vector<Price> reserve_price;                 //per share cash held for each working buy
+	std::unordered_map<std::string, std::size_t> order_index;
+	std::set<std::size_t> working_orders;
+	std::unordered_map<SymbolId, Book> books;
+	std::unordered_map<SymbolId, Position> holdings;
+	Account balance;
+	int64_t clock;                                     //latest quote time seen, microseconds
+	uint64_t fills;
+};
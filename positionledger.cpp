@@ -0,0 +1,250 @@
+/* positionledger.cpp: positions & P&L kept locally from our fills & quotes, reconciled with the broker */
+
+#include <cmath>
+#include <cstdlib>
+#include <unordered_set>
+
+#include "positionledger.h"
+#include "exceptions.h"
+#include "logger.h"
+
+using namespace std;
+
+//value(): quantity shares at price, in Price ticks; split so whole shares can't overflow.
+static int64_t value(int64_t quantity, int64_t price) {
+	return quantity / price_scale * price + quantity % price_scale * price / price_scale;
+}
+
+static int64_t now_micros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+PositionLedger::PositionLedger(Sync sync)
+	: sync(sync), totals(), correction_count(0), stopping(false) {
+}
+
+PositionLedger::~PositionLedger() {
+	stop();
+}
+
+void PositionLedger::add_totals(const Holding &holding, int sign) {
+	int64_t market = holding.marked ? value(holding.quantity, holding.mark) : holding.cost;
+	if (holding.quantity > 0)
+		totals.long_value.ticks += sign * market;
+	else
+		totals.short_value.ticks += sign * market;
+	totals.cost.ticks += sign * holding.cost;
+	totals.realized.ticks += sign * holding.realized;
+	totals.unrealized.ticks += sign * (market - holding.cost);
+}
+
+/* fill(): Average cost accounting.  Shares adding to the position add their cost; shares reducing
+   it take out the average cost of what they close & realize the difference to price.  A fill
+   crossing zero closes the position & opens the rest on the other side at price.
+*/
+void PositionLedger::fill(SymbolId symbol, int64_t quantity, int64_t price, int64_t time) {
+	Holding &holding = holdings[symbol];
+	add_totals(holding, -1);
+	if (holding.quantity == 0 || (holding.quantity > 0) == (quantity > 0)) {
+		holding.quantity += quantity;
+		holding.cost += value(quantity, price);
+	}
+	else {
+		int64_t closed = llabs(quantity) <= llabs(holding.quantity) ? quantity : -holding.quantity;
+		int64_t closedCost = closed == -holding.quantity ? holding.cost
+			: int64_t(llroundl((long double)holding.cost * -closed / holding.quantity));
+		holding.realized += value(-closed, price) - closedCost;
+		holding.quantity += closed;
+		holding.cost -= closedCost;
+
+		int64_t opened = quantity - closed;
+		holding.quantity += opened;
+		holding.cost += value(opened, price);
+	}
+	if (!holding.marked) {
+		holding.mark = price;
+		holding.marked = true;
+	}
+	holding.updated_at = time ? time : now_micros();
+	add_totals(holding, 1);
+}
+
+void PositionLedger::on_fill(SymbolId symbol, Side side, Price quantity, Price price, int64_t time) {
+	if (!symbol || quantity.ticks <= 0)
+		return;
+	lock_guard<mutex> lock(ledger_mutex);
+	fill(symbol, side == BUY ? quantity.ticks : -quantity.ticks, price.ticks, time);
+}
+
+void PositionLedger::on_order(const Order &previous, const Order &current) {
+	int64_t filled = current.cumulative_quantity.ticks - previous.cumulative_quantity.ticks;
+	if (filled <= 0 || !current.symbol)
+		return;
+
+	//Price of the new shares: how much the order's notional grew, per share.
+	long double notional = (long double)current.cumulative_quantity.ticks * current.average_price.ticks
+		- (long double)previous.cumulative_quantity.ticks * previous.average_price.ticks;
+	int64_t price = llroundl(notional / filled);
+	if (price <= 0)
+		price = current.average_price.ticks ? current.average_price.ticks : current.price.ticks;
+
+	lock_guard<mutex> lock(ledger_mutex);
+	fill(current.symbol, current.side == BUY ? filled : -filled, price, current.updated_at);
+}
+
+void PositionLedger::mark(SymbolId symbol, Price price) {
+	if (price.ticks <= 0)
+		return;
+	lock_guard<mutex> lock(ledger_mutex);
+	auto found = holdings.find(symbol);
+	if (found == holdings.end())
+		return;
+	Holding &holding = found->second;
+	if (holding.marked && holding.mark == price.ticks)
+		return;
+	add_totals(holding, -1);
+	holding.mark = price.ticks;
+	holding.marked = true;
+	add_totals(holding, 1);
+}
+
+void PositionLedger::on_quote(const Quote &quote) {
+	if (quote.last_trade_price.ticks > 0)
+		mark(quote.symbol, quote.last_trade_price);
+	else if (quote.bid_price.ticks > 0 && quote.ask_price.ticks > 0)
+		mark(quote.symbol, Price{ (quote.bid_price.ticks + quote.ask_price.ticks) / 2 });
+}
+
+size_t PositionLedger::reconcile(const vector<Position> &positions) {
+	size_t corrected = 0;
+	lock_guard<mutex> lock(ledger_mutex);
+	unordered_set<SymbolId> held;
+	for (const Position &position : positions) {
+		if (!position.symbol || position.quantity.ticks == 0)
+			continue;
+		held.insert(position.symbol);
+		Holding &holding = holdings[position.symbol];
+		int64_t average = holding.quantity ? llroundl((long double)holding.cost * price_scale / holding.quantity) : 0;
+		if (holding.quantity == position.quantity.ticks && llabs(average - position.average_buy_price.ticks) <= 1)
+			continue;
+
+		RH_LOG(LOG_INFO, "PositionLedger: {} held {} at {}, broker has {} at {}", SymbolTable::instance().name(position.symbol),
+			Price{ holding.quantity }, Price{ average }, position.quantity, position.average_buy_price);
+		add_totals(holding, -1);
+		holding.quantity = position.quantity.ticks;
+		holding.cost = value(position.quantity.ticks, position.average_buy_price.ticks);
+		holding.updated_at = position.updated_at ? position.updated_at : now_micros();
+		add_totals(holding, 1);
+		corrected++;
+	}
+	//Whatever the broker doesn't list is flat.
+	for (auto &entry : holdings) {
+		Holding &holding = entry.second;
+		if (holding.quantity == 0 || held.count(entry.first))
+			continue;
+		RH_LOG(LOG_INFO, "PositionLedger: {} held {}, broker has none", SymbolTable::instance().name(entry.first), Price{ holding.quantity });
+		add_totals(holding, -1);
+		holding.quantity = 0;
+		holding.cost = 0;
+		holding.updated_at = now_micros();
+		add_totals(holding, 1);
+		corrected++;
+	}
+	correction_count += corrected;
+	return corrected;
+}
+
+size_t PositionLedger::reconcile() {
+	if (!sync)
+		throw RobinhoodException("PositionLedger::reconcile(): No way to fetch positions");
+	return sync(*this);
+}
+
+void PositionLedger::start(chrono::seconds interval) {
+	lock_guard<mutex> lock(run_mutex);
+	if (reconciler.joinable())
+		return;
+	stopping = false;
+	reconciler = thread(&PositionLedger::run, this, interval);
+}
+
+void PositionLedger::stop() {
+	{
+		lock_guard<mutex> lock(run_mutex);
+		if (!reconciler.joinable())
+			return;
+		stopping = true;
+	}
+	wake.notify_all();
+	reconciler.join();
+	reconciler = thread();
+}
+
+bool PositionLedger::running() const {
+	lock_guard<mutex> lock(run_mutex);
+	return reconciler.joinable() && !stopping;
+}
+
+//run(): Reconciler thread. Reconciles right away, then every interval until stopped.
+void PositionLedger::run(chrono::seconds interval) {
+	unique_lock<mutex> lock(run_mutex);
+	while (!stopping) {
+		lock.unlock();
+		try {
+			reconcile();
+		}
+		catch (const exception &e) {
+			RH_LOG(LOG_WARNING, "PositionLedger: reconcile failed: {}", e.what());
+		}
+		lock.lock();
+		wake.wait_for(lock, interval, [this] { return stopping; });
+	}
+}
+
+LedgerPosition PositionLedger::describe(SymbolId symbol, const Holding &holding) {
+	LedgerPosition position;
+	position.symbol = symbol;
+	position.quantity = Price{ holding.quantity };
+	position.cost = Price{ holding.cost };
+	position.average_cost = Price{ holding.quantity ? llroundl((long double)holding.cost * price_scale / holding.quantity) : 0 };
+	position.mark = holding.marked ? Price{ holding.mark } : position.average_cost;
+	position.market_value = holding.marked ? Price{ value(holding.quantity, holding.mark) } : position.cost;
+	position.realized = Price{ holding.realized };
+	position.unrealized = Price{ position.market_value.ticks - holding.cost };
+	position.updated_at = holding.updated_at;
+	return position;
+}
+
+bool PositionLedger::find(SymbolId symbol, LedgerPosition &position) const {
+	lock_guard<mutex> lock(ledger_mutex);
+	auto found = holdings.find(symbol);
+	if (found == holdings.end())
+		return false;
+	position = describe(symbol, found->second);
+	return true;
+}
+
+vector<LedgerPosition> PositionLedger::positions() const {
+	vector<LedgerPosition> result;
+	lock_guard<mutex> lock(ledger_mutex);
+	result.reserve(holdings.size());
+	for (auto &entry : holdings)
+		result.push_back(describe(entry.first, entry.second));
+	return result;
+}
+
+Exposure PositionLedger::exposure() const {
+	lock_guard<mutex> lock(ledger_mutex);
+	return totals;
+}
+
+uint64_t PositionLedger::corrections() const {
+	lock_guard<mutex> lock(ledger_mutex);
+	return correction_count;
+}
+
+void PositionLedger::clear() {
+	lock_guard<mutex> lock(ledger_mutex);
+	holdings.clear();
+	totals = Exposure();
+}
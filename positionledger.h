@@ -0,0 +1,111 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "records.h"
+
+//LedgerPosition: one symbol's holding. Money is in Price ticks (1 tick = $0.0001).
+struct LedgerPosition {
+	SymbolId symbol;
+	Price quantity;            //shares, negative if short
+	Price average_cost;        //per share
+	Price cost;                //quantity * average_cost
+	Price mark;                //latest quote price, average_cost until one is seen
+	Price market_value;        //quantity * mark
+	Price realized;            //P&L of the shares closed so far
+	Price unrealized;          //market_value - cost
+	int64_t updated_at;        //microseconds since epoch
+};
+
+//Exposure: portfolio totals of a PositionLedger.
+struct Exposure {
+	Price long_value;          //market value of long positions
+	Price short_value;         //of short positions, <= 0
+	Price cost;
+	Price realized;
+	Price unrealized;
+
+	Price net() const { return Price{ long_value.ticks + short_value.ticks }; }
+	Price gross() const { return Price{ long_value.ticks - short_value.ticks }; }
+};
+
+/* PositionLedger: our positions kept up to date locally from our own fills & quotes, at average
+   cost.  Portfolio totals are adjusted as each position changes, so exposure() is a copy
+   rather than an HTTP call & a walk of positions_nonzero().  Fills the ledger did not see
+   (other sessions, missed polls) are corrected by reconcile(), which adopts the broker's
+   quantities & average costs; start() runs it periodically.  Thread safe.
+*/
+class PositionLedger {
+public:
+	/* Sync: bring the ledger in line with the broker by passing its open positions (symbols
+	   resolved) to reconcile(positions).  Fills already in those positions must have reached
+	   on_order() first & none may reach it until they are adopted, or they count twice; the
+	   trader polls its orders & fetches positions without another poll in between.
+	*/
+	typedef std::function<std::size_t(PositionLedger &ledger)> Sync;
+
+	explicit PositionLedger(Sync sync = nullptr);
+	~PositionLedger();
+
+	PositionLedger(const PositionLedger &) = delete;
+	PositionLedger &operator=(const PositionLedger &) = delete;
+
+	//on_fill(): quantity shares of symbol bought or sold at price.
+	void on_fill(SymbolId symbol, Side side, Price quantity, Price price, int64_t time = 0);
+	//on_order(): OrderManager listener; new fills are the rise of cumulative_quantity, priced from
+	//the change of average_price.
+	void on_order(const Order &previous, const Order &current);
+	//mark(): Value symbol at price from now on (the last trade, or the mid if there was none).
+	void mark(SymbolId symbol, Price price);
+	void on_quote(const Quote &quote);
+
+	//reconcile(): Adopt positions as the truth; symbols missing from them are flat. Realized P&L
+	//is kept. Returns the number of symbols corrected.
+	std::size_t reconcile(const std::vector<Position> &positions);
+	//reconcile(): Through the Sync given at construction. Throws what it throws.
+	std::size_t reconcile();
+	//Reconcile every interval on a background thread; failures are logged & retried next time.
+	void start(std::chrono::seconds interval = std::chrono::seconds(60));
+	void stop();
+	bool running() const;
+
+	bool find(SymbolId symbol, LedgerPosition &position) const;
+	std::vector<LedgerPosition> positions() const;
+	Exposure exposure() const;
+	//corrections(): Symbols reconcile() had to correct since construction.
+	uint64_t corrections() const;
+	void clear();
+
+private:
+	struct Holding {
+		int64_t quantity = 0;
+		int64_t cost = 0;
+		int64_t mark = 0;
+		bool marked = false;
+		int64_t realized = 0;
+		int64_t updated_at = 0;
+	};
+
+	//add_totals(): Add (sign 1) or remove (sign -1) a holding's share of the totals.
+	void add_totals(const Holding &holding, int sign);
+	//fill(): Caller holds ledger_mutex. quantity is negative for sells.
+	void fill(SymbolId symbol, int64_t quantity, int64_t price, int64_t time);
+	static LedgerPosition describe(SymbolId symbol, const Holding &holding);
+	void run(std::chrono::seconds interval);
+
+	Sync sync;
+	mutable std::mutex ledger_mutex;
+	std::unordered_map<SymbolId, Holding> holdings;
+	Exposure totals;
+	uint64_t correction_count;
+
+	mutable std::mutex run_mutex;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread reconciler;
+};
@@ -0,0 +1,107 @@
+/* quotecache.cpp: TTL quote cache with single-flight request coalescing */
+
+#include "quotecache.h"
+
+using namespace std;
+
+QuoteCache::QuoteCache(Fetch fetch, chrono::milliseconds ttl)
+	: fetch(fetch), ttl_ms(ttl), fetch_count(0), hit_count(0) {
+}
+
+Quote QuoteCache::get(const string &symbol) {
+	SymbolId id = SymbolTable::instance().intern(symbol);
+
+	shared_future<Quote> pending;
+	promise<Quote> result;
+	{
+		lock_guard<mutex> lock(cache_mutex);
+		Entry &entry = entries[id];
+		if (entry.valid && Clock::now() - entry.fetched < ttl_ms) {
+			hit_count++;
+			return entry.quote;
+		}
+		if (entry.inflight.valid()) {
+			hit_count++;
+			pending = entry.inflight;
+		}
+		else {
+			entry.inflight = result.get_future().share();
+			fetch_count++;
+		}
+	}
+
+	//Someone is already fetching this symbol: wait for their answer.
+	if (pending.valid())
+		return pending.get();
+
+	//Fetch outside the lock so other symbols aren't blocked.
+	Quote quote;
+	try {
+		quote = fetch(symbol);
+	}
+	catch (...) {
+		{
+			lock_guard<mutex> lock(cache_mutex);
+			entries[id].inflight = shared_future<Quote>();
+		}
+		result.set_exception(current_exception());
+		throw;
+	}
+
+	{
+		lock_guard<mutex> lock(cache_mutex);
+		Entry &entry = entries[id];
+		entry.quote = quote;
+		entry.fetched = Clock::now();
+		entry.valid = true;
+		entry.inflight = shared_future<Quote>();
+	}
+	result.set_value(quote);
+	return quote;
+}
+
+void QuoteCache::put(const Quote &quote) {
+	if (quote.symbol == 0)
+		return;
+	lock_guard<mutex> lock(cache_mutex);
+	Entry &entry = entries[quote.symbol];
+	entry.quote = quote;
+	entry.fetched = Clock::now();
+	entry.valid = true;
+}
+
+void QuoteCache::set_ttl(chrono::milliseconds ttl) {
+	lock_guard<mutex> lock(cache_mutex);
+	ttl_ms = ttl;
+}
+
+chrono::milliseconds QuoteCache::ttl() const {
+	lock_guard<mutex> lock(cache_mutex);
+	return ttl_ms;
+}
+
+void QuoteCache::invalidate(const string &symbol) {
+	SymbolId id = SymbolTable::instance().find(symbol);
+	if (id == 0)
+		return;
+	lock_guard<mutex> lock(cache_mutex);
+	auto it = entries.find(id);
+	if (it != entries.end())
+		it->second.valid = false;
+}
+
+void QuoteCache::clear() {
+	lock_guard<mutex> lock(cache_mutex);
+	for (auto &entry : entries)
+		entry.second.valid = false;
+}
+
+size_t QuoteCache::fetches() const {
+	lock_guard<mutex> lock(cache_mutex);
+	return fetch_count;
+}
+
+size_t QuoteCache::hits() const {
+	lock_guard<mutex> lock(cache_mutex);
+	return hit_count;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include "records.h"
+
+/* QuoteCache: per-symbol quotes that are reused while younger than the TTL.  Concurrent callers
+   asking for the same stale symbol share one request (single flight): the first fetches, the
+   others wait for its result.  A TTL of zero disables reuse but still coalesces.  Thread safe.
+*/
+class QuoteCache {
+public:
+	typedef std::function<Quote(const std::string &symbol)> Fetch;
+
+	explicit QuoteCache(Fetch fetch, std::chrono::milliseconds ttl = std::chrono::milliseconds(500));
+
+	QuoteCache(const QuoteCache &) = delete;
+	QuoteCache &operator=(const QuoteCache &) = delete;
+
+	//get(): Quote of symbol (upper case), fetched only if the cached one is older than the TTL.
+	Quote get(const std::string &symbol);
+	//put(): Store a quote fetched elsewhere, e.g. by a batch request.
+	void put(const Quote &quote);
+
+	void set_ttl(std::chrono::milliseconds ttl);
+	std::chrono::milliseconds ttl() const;
+	void invalidate(const std::string &symbol);
+	void clear();
+
+	//Counters since construction: requests made vs calls answered from cache or a shared request.
+	std::size_t fetches() const;
+	std::size_t hits() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Entry {
+		Quote quote = {};
+		Clock::time_point fetched;
+		bool valid = false;
+		std::shared_future<Quote> inflight;    //valid() while a request for the symbol is running
+	};
+
+	Fetch fetch;
+	std::chrono::milliseconds ttl_ms;
+	mutable std::mutex cache_mutex;
+	std::unordered_map<SymbolId, Entry> entries;
+	std::size_t fetch_count;
+	std::size_t hit_count;
+};
@@ -0,0 +1,238 @@
+/* quotepoller.cpp: background quote polling into a sequence locked snapshot table */
+
+#include <algorithm>
+
+#include "quotepoller.h"
+#include "exceptions.h"
+
+using namespace std;
+
+//upper_symbol(): Symbols are interned & looked up in upper case.
+static string upper_symbol(const string &symbol) {
+	string upper(symbol);
+	std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+	return upper;
+}
+
+static int64_t steady_micros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QuoteSnapshotTable::QuoteSnapshotTable(size_t capacity)
+	: symbolCapacity(capacity), slotCount(2 * capacity + 1), claimed(0), slots(new Slot[2 * capacity + 1]) {
+	for (size_t i = 0; i < slotCount; i++) {
+		slots[i].symbol.store(0, memory_order_relaxed);
+		slots[i].sequence.store(0, memory_order_relaxed);
+		slots[i].published.store(0, memory_order_relaxed);
+		for (size_t w = 0; w < quoteWords; w++)
+			slots[i].words[w].store(0, memory_order_relaxed);
+	}
+}
+
+//find(): Linear probing from the symbol's id; an unclaimed slot ends the search.
+QuoteSnapshotTable::Slot *QuoteSnapshotTable::find(SymbolId symbol, bool claim) {
+	if (symbol == 0)
+		return nullptr;
+	size_t index = symbol % slotCount;
+	for (size_t probe = 0; probe < slotCount; probe++, index = (index + 1) % slotCount) {
+		SymbolId owner = slots[index].symbol.load(memory_order_acquire);
+		if (owner == symbol)
+			return &slots[index];
+		if (owner == 0) {
+			if (!claim || claimed >= symbolCapacity)
+				return nullptr;
+			claimed++;
+			slots[index].symbol.store(symbol, memory_order_release);
+			return &slots[index];
+		}
+	}
+	return nullptr;
+}
+
+void QuoteSnapshotTable::publish(const Quote &quote) {
+	Slot *found = find(quote.symbol, true);
+	if (!found)
+		return;
+	Slot &slot = *found;
+
+	uint64_t words[quoteWords];
+	memcpy(words, &quote, sizeof(Quote));
+
+	uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+	slot.sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (size_t w = 0; w < quoteWords; w++)
+		slot.words[w].store(words[w], memory_order_relaxed);
+	slot.published.store(steady_micros(), memory_order_relaxed);
+	slot.sequence.store(sequence + 2, memory_order_release);
+}
+
+bool QuoteSnapshotTable::read(SymbolId symbol, Quote &quote) const {
+	const Slot *found = find(symbol);
+	if (!found)
+		return false;
+	const Slot &slot = *found;
+
+	uint64_t words[quoteWords];
+	uint64_t before, after;
+	do {
+		before = slot.sequence.load(memory_order_acquire);
+		if (before == 0)
+			return false;
+		for (size_t w = 0; w < quoteWords; w++)
+			words[w] = slot.words[w].load(memory_order_relaxed);
+		atomic_thread_fence(memory_order_acquire);
+		after = slot.sequence.load(memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	memcpy(&quote, words, sizeof(Quote));
+	return true;
+}
+
+chrono::microseconds QuoteSnapshotTable::age(SymbolId symbol) const {
+	const Slot *slot = find(symbol);
+	if (!slot || slot->sequence.load(memory_order_acquire) == 0)
+		return chrono::microseconds::max();
+	return chrono::microseconds(steady_micros() - slot->published.load(memory_order_relaxed));
+}
+
+QuotePoller::QuotePoller(Fetch fetch, chrono::milliseconds interval, size_t capacity)
+	: fetch(fetch), table(capacity), active(false), stopping(false),
+	  interval_ms(interval.count()), max_staleness_ms(4 * interval.count()),
+	  cycles(0), errors(0), last_cycle_us(0), max_cycle_us(0), total_cycle_us(0), last_success(0) {
+}
+
+QuotePoller::~QuotePoller() {
+	stop();
+}
+
+void QuotePoller::subscribe(const string &stock) {
+	string symbol = upper_symbol(stock);
+	SymbolId id = SymbolTable::instance().intern(symbol);
+
+	lock_guard<mutex> lock(poller_mutex);
+	if (find(symbols.begin(), symbols.end(), symbol) != symbols.end())
+		return;
+	if (!slotted.count(id) && slotted.size() >= table.capacity())
+		throw RobinhoodException("QuotePoller::subscribe(): Capacity of " + to_string(table.capacity()) + " symbols reached");
+	slotted.insert(id);
+	symbols.push_back(symbol);
+}
+
+void QuotePoller::unsubscribe(const string &stock) {
+	string symbol = upper_symbol(stock);
+	lock_guard<mutex> lock(poller_mutex);
+	symbols.erase(remove(symbols.begin(), symbols.end(), symbol), symbols.end());
+}
+
+vector<string> QuotePoller::subscriptions() const {
+	lock_guard<mutex> lock(poller_mutex);
+	return symbols;
+}
+
+void QuotePoller::set_listener(Listener listener) {
+	lock_guard<mutex> lock(poller_mutex);
+	this->listener = listener;
+}
+
+void QuotePoller::start() {
+	lock_guard<mutex> lock(poller_mutex);
+	if (worker.joinable())
+		return;
+	stopping = false;
+	active.store(true, memory_order_release);
+	worker = thread(&QuotePoller::run, this);
+}
+
+void QuotePoller::stop() {
+	{
+		lock_guard<mutex> lock(poller_mutex);
+		if (!worker.joinable())
+			return;
+		stopping = true;
+		active.store(false, memory_order_release);
+	}
+	wakeup.notify_all();
+	worker.join();
+}
+
+void QuotePoller::set_interval(chrono::milliseconds interval) {
+	interval_ms.store(interval.count(), memory_order_relaxed);
+}
+
+void QuotePoller::set_max_staleness(chrono::milliseconds staleness) {
+	max_staleness_ms.store(staleness.count(), memory_order_relaxed);
+}
+
+bool QuotePoller::read_fresh(SymbolId symbol, Quote &quote) const {
+	if (!running())
+		return false;
+	if (table.age(symbol) > chrono::milliseconds(max_staleness_ms.load(memory_order_relaxed)))
+		return false;
+	return table.read(symbol, quote);
+}
+
+PollerStats QuotePoller::stats() const {
+	PollerStats stats;
+	stats.interval = chrono::milliseconds(interval_ms.load(memory_order_relaxed));
+	stats.cycles = cycles.load(memory_order_relaxed);
+	stats.errors = errors.load(memory_order_relaxed);
+	stats.last_cycle = chrono::microseconds(last_cycle_us.load(memory_order_relaxed));
+	stats.max_cycle = chrono::microseconds(max_cycle_us.load(memory_order_relaxed));
+	uint64_t polls = stats.cycles + stats.errors;
+	stats.mean_cycle = chrono::microseconds(polls ? total_cycle_us.load(memory_order_relaxed) / int64_t(polls) : 0);
+	int64_t success = last_success.load(memory_order_relaxed);
+	stats.staleness = success ? chrono::microseconds(steady_micros() - success) : chrono::microseconds::max();
+	return stats;
+}
+
+//poll_once(): One batched request for every subscribed symbol.
+void QuotePoller::poll_once() {
+	vector<string> batch;
+	Listener notify;
+	{
+		lock_guard<mutex> lock(poller_mutex);
+		batch = symbols;
+		notify = listener;
+	}
+	if (batch.empty())
+		return;
+
+	int64_t started = steady_micros();
+	try {
+		vector<Quote> quotes = fetch(batch);
+		for (const Quote &quote : quotes)
+			table.publish(quote);
+		cycles.fetch_add(1, memory_order_relaxed);
+		last_success.store(steady_micros(), memory_order_relaxed);
+		if (notify)
+			notify(quotes);
+	}
+	catch (const exception &) {
+		//Keep polling; readers see the quotes going stale.
+		errors.fetch_add(1, memory_order_relaxed);
+	}
+
+	int64_t elapsed = steady_micros() - started;
+	last_cycle_us.store(elapsed, memory_order_relaxed);
+	total_cycle_us.fetch_add(elapsed, memory_order_relaxed);
+	if (elapsed > max_cycle_us.load(memory_order_relaxed))
+		max_cycle_us.store(elapsed, memory_order_relaxed);
+}
+
+void QuotePoller::run() {
+	auto next = chrono::steady_clock::now();
+	for (;;) {
+		poll_once();
+
+		next += chrono::milliseconds(interval_ms.load(memory_order_relaxed));
+		auto now = chrono::steady_clock::now();
+		if (next < now)
+			next = now;    //overran: poll again right away rather than bursting to catch up
+
+		unique_lock<mutex> lock(poller_mutex);
+		wakeup.wait_until(lock, next, [this] { return stopping; });
+		if (stopping)
+			return;
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <unordered_set>
+#include <condition_variable>
+#include <type_traits>
+#include "records.h"
+
+/* QuoteSnapshotTable: latest quote of up to capacity symbols.  A symbol's slot is found by
+   linear probing from its SymbolId & claimed by its first publish, so ids from a large
+   SymbolTable fit a small table.  One writer publishes through a per-slot sequence lock;
+   readers copy the slot & retry if it changed underneath them, so they never take a lock or
+   wait for the writer's thread.
+*/
+class QuoteSnapshotTable {
+public:
+	explicit QuoteSnapshotTable(std::size_t capacity);
+
+	QuoteSnapshotTable(const QuoteSnapshotTable &) = delete;
+	QuoteSnapshotTable &operator=(const QuoteSnapshotTable &) = delete;
+
+	std::size_t capacity() const { return symbolCapacity; }
+	//publish(): Store quote under quote.symbol. Single writer only; symbols beyond capacity are dropped.
+	void publish(const Quote &quote);
+	//read(): Copy of the latest quote of symbol. Returns false if none was published yet.
+	bool read(SymbolId symbol, Quote &quote) const;
+	//age(): Time since symbol was last published; max() if never.
+	std::chrono::microseconds age(SymbolId symbol) const;
+
+private:
+	static_assert(sizeof(Quote) % sizeof(uint64_t) == 0, "Quote must be a whole number of 64-bit words");
+	static_assert(std::is_trivially_copyable<Quote>::value, "Quote is copied word by word");
+	static const std::size_t quoteWords = sizeof(Quote) / sizeof(uint64_t);
+
+	struct Slot {
+		std::atomic<SymbolId> symbol;          //owner, 0 until claimed; slots are never given up
+		std::atomic<uint64_t> sequence;        //odd while a write is in progress, 0 if never written
+		std::atomic<int64_t> published;        //steady clock, microseconds
+		std::atomic<uint64_t> words[quoteWords];
+	};
+
+	//find(): The slot of symbol, claimed if claim is set & it has none. nullptr if absent or full.
+	Slot *find(SymbolId symbol, bool claim);
+	const Slot *find(SymbolId symbol) const { return const_cast<QuoteSnapshotTable *>(this)->find(symbol, false); }
+
+	std::size_t symbolCapacity;
+	std::size_t slotCount;                     //twice symbolCapacity, keeping probes short
+	std::size_t claimed;                       //writer only
+	std::unique_ptr<Slot[]> slots;
+};
+
+//PollerStats: cadence & health of a QuotePoller.
+struct PollerStats {
+	std::chrono::milliseconds interval;    //configured cadence
+	uint64_t cycles;                       //completed polls
+	uint64_t errors;                       //polls that threw
+	std::chrono::microseconds last_cycle;  //latency of the latest poll
+	std::chrono::microseconds max_cycle;
+	std::chrono::microseconds mean_cycle;
+	std::chrono::microseconds staleness;   //time since the latest successful poll; max() if none
+};
+
+/* QuotePoller: refreshes a set of subscribed symbols on its own thread with batched quote
+   requests & publishes them into a QuoteSnapshotTable, so readers get in-memory quotes
+   instead of a blocking request each.  Polls run at a fixed rate; a poll that overruns the
+   interval is followed immediately by the next one.
+*/
+class QuotePoller {
+public:
+	typedef std::function<std::vector<Quote>(const std::vector<std::string> &symbols)> Fetch;
+	//Listener: sees every successful poll on the poller thread, e.g. to record it.
+	typedef std::function<void(const std::vector<Quote> &quotes)> Listener;
+
+	//capacity: symbols that may be subscribed over the poller's life.
+	QuotePoller(Fetch fetch, std::chrono::milliseconds interval = std::chrono::milliseconds(250), std::size_t capacity = 1024);
+	~QuotePoller();
+
+	QuotePoller(const QuotePoller &) = delete;
+	QuotePoller &operator=(const QuotePoller &) = delete;
+
+	//subscribe(): Add symbol (any case, polled in upper case) to the polled set. Takes effect on the next poll.
+	void subscribe(const std::string &symbol);
+	void unsubscribe(const std::string &symbol);
+	std::vector<std::string> subscriptions() const;
+	void set_listener(Listener listener);
+
+	void start();
+	void stop();
+	bool running() const { return active.load(std::memory_order_acquire); }
+
+	//set_interval(): New cadence, applied after the current wait.
+	void set_interval(std::chrono::milliseconds interval);
+	//Quotes older than this are treated as missing by read_fresh(). Default: 4 intervals.
+	void set_max_staleness(std::chrono::milliseconds staleness);
+
+	//read(): Latest polled quote of symbol, regardless of age.
+	bool read(SymbolId symbol, Quote &quote) const { return table.read(symbol, quote); }
+	//read_fresh(): Latest polled quote if the poller is running & the quote is within max staleness.
+	bool read_fresh(SymbolId symbol, Quote &quote) const;
+	std::chrono::microseconds staleness(SymbolId symbol) const { return table.age(symbol); }
+	PollerStats stats() const;
+
+private:
+	void run();
+	void poll_once();
+
+	Fetch fetch;
+	QuoteSnapshotTable table;
+
+	mutable std::mutex poller_mutex;
+	std::condition_variable wakeup;
+	std::vector<std::string> symbols;
+	std::unordered_set<SymbolId> slotted;      //every symbol subscribed so far; each keeps its table slot
+	Listener listener;
+	std::atomic<bool> active;
+	bool stopping;
+	std::thread worker;
+
+	std::atomic<int64_t> interval_ms;
+	std::atomic<int64_t> max_staleness_ms;
+	std::atomic<uint64_t> cycles;
+	std::atomic<uint64_t> errors;
+	std::atomic<int64_t> last_cycle_us;
+	std::atomic<int64_t> max_cycle_us;
+	std::atomic<int64_t> total_cycle_us;
+	std::atomic<int64_t> last_success;      //steady clock microseconds, 0 if none
+};
@@ -0,0 +1,205 @@
+/* quotereplay.cpp: quotes served from recorded tick files */
+
+#include <fstream>
+#include <unordered_map>
+
+#include "quotereplay.h"
+#include "recordparser.h"
+#include "exceptions.h"
+
+using namespace std;
+
+QuoteReplay::QuoteReplay(const vector<string> &files, Mode mode, double speed)
+	: replayMode(mode), speed(mode == WALL_CLOCK ? 1.0 : speed) {
+	if (files.empty())
+		throw RobinhoodException("QuoteReplay(): no tick files given");
+	if (mode == ACCELERATED && speed <= 0)
+		throw RobinhoodException("QuoteReplay(): speed must be positive");
+	for (const string &path : files)
+		readers.emplace_back(new TickReader(path));
+	rewind();
+}
+
+void QuoteReplay::rewind() {
+	lock_guard<mutex> lock(replay_mutex);
+	fileIndex = 0;
+	recordIndex = 0;
+	replayCount = 0;
+	latest.clear();
+	exhausted.clear();
+
+	firstTimestamp = 0;
+	for (auto &reader : readers) {
+		if (reader->size()) {
+			firstTimestamp = (*reader)[0].timestamp;
+			break;
+		}
+	}
+	replayTime = firstTimestamp;
+	started = chrono::steady_clock::now();
+}
+
+bool QuoteReplay::finished() const {
+	lock_guard<mutex> lock(replay_mutex);
+	return fileIndex >= readers.size();
+}
+
+int64_t QuoteReplay::now() const {
+	lock_guard<mutex> lock(replay_mutex);
+	return replayTime;
+}
+
+uint64_t QuoteReplay::replayed() const {
+	lock_guard<mutex> lock(replay_mutex);
+	return replayCount;
+}
+
+//apply(): Make record the latest quote of its symbol. Caller holds replay_mutex.
+void QuoteReplay::apply(const TickReader &reader, const TickRecord &record) {
+	Quote quote = reader.quote(record);
+	if (quote.symbol >= latest.size())
+		latest.resize(quote.symbol + 1, Quote());
+	latest[quote.symbol] = quote;
+	replayTime = record.timestamp;
+	replayCount++;
+}
+
+//step(): Apply the next record. Returns false at the end of the last file.
+bool QuoteReplay::step() {
+	while (fileIndex < readers.size()) {
+		const TickReader &reader = *readers[fileIndex];
+		if (recordIndex < reader.size()) {
+			apply(reader, reader[recordIndex++]);
+			return true;
+		}
+		fileIndex++;
+		recordIndex = 0;
+	}
+	return false;
+}
+
+//advance_to(): Apply every record up to timestamp.
+void QuoteReplay::advance_to(int64_t timestamp) {
+	while (fileIndex < readers.size()) {
+		const TickReader &reader = *readers[fileIndex];
+		if (recordIndex >= reader.size()) {
+			fileIndex++;
+			recordIndex = 0;
+			continue;
+		}
+		if (reader[recordIndex].timestamp > timestamp)
+			break;
+		apply(reader, reader[recordIndex++]);
+	}
+	if (timestamp > replayTime)
+		replayTime = timestamp;
+}
+
+/* advance_symbol(): Apply records up to & including the next one of symbol.  If the symbol has
+   no more records nothing is applied, so a finished symbol doesn't fast-forward the others.
+*/
+void QuoteReplay::advance_symbol(SymbolId symbol) {
+	if (symbol < exhausted.size() && exhausted[symbol])
+		return;
+
+	size_t file = fileIndex, index = recordIndex;
+	while (file < readers.size()) {
+		const TickReader &reader = *readers[file];
+		for (; index < reader.size(); index++) {
+			if (reader.symbol_id(reader[index].symbol) == symbol) {
+				while (fileIndex < file || recordIndex <= index)
+					step();
+				return;
+			}
+		}
+		file++;
+		index = 0;
+	}
+
+	if (symbol >= exhausted.size())
+		exhausted.resize(symbol + 1, false);
+	exhausted[symbol] = true;
+}
+
+void QuoteReplay::sync_clock() {
+	double elapsed = double(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count());
+	advance_to(firstTimestamp + static_cast<int64_t>(elapsed * speed));
+}
+
+bool QuoteReplay::quote(SymbolId symbol, Quote &quote) {
+	if (symbol == 0)
+		return false;
+	lock_guard<mutex> lock(replay_mutex);
+	if (replayMode == AS_FAST_AS_POSSIBLE)
+		advance_symbol(symbol);
+	else
+		sync_clock();
+	return latest_of(symbol, quote);
+}
+
+bool QuoteReplay::current(SymbolId symbol, Quote &quote) {
+	if (symbol == 0)
+		return false;
+	lock_guard<mutex> lock(replay_mutex);
+	if (replayMode != AS_FAST_AS_POSSIBLE)
+		sync_clock();
+	return latest_of(symbol, quote);
+}
+
+//latest_of(): Caller holds replay_mutex.
+bool QuoteReplay::latest_of(SymbolId symbol, Quote &quote) const {
+	if (symbol >= latest.size() || latest[symbol].symbol == 0)
+		return false;
+	quote = latest[symbol];
+	return true;
+}
+
+Quote QuoteReplay::get_quote(const string &symbol) {
+	Quote result;
+	if (!quote(SymbolTable::instance().find(symbol), result))
+		throw RobinhoodException("QuoteReplay::get_quote(): No recorded quote for " + symbol + " at " + format_timestamp(now()));
+	return result;
+}
+
+uint64_t QuoteReplay::import_json_lines(const string &jsonPath, const string &directory) {
+	ifstream in(jsonPath);
+	if (!in)
+		throw RobinhoodException("QuoteReplay::import_json_lines(): Couldn't open " + jsonPath);
+
+	TickRecorder recorder(directory);
+	unordered_map<SymbolId, int64_t> lastUpdate;
+	uint64_t written = 0;
+
+	auto import = [&](const json &jsonQuote) {
+		Quote quote = parse_quote(jsonQuote);
+		if (quote.symbol == 0 || quote.updated_at == 0)
+			return;
+		int64_t &previous = lastUpdate[quote.symbol];
+		if (previous == quote.updated_at)
+			return;
+		previous = quote.updated_at;
+		recorder.record(quote, quote.updated_at);
+		written++;
+	};
+
+	string line;
+	size_t lineNumber = 0;
+	while (getline(in, line)) {
+		lineNumber++;
+		if (line.find_first_not_of(" \t\r") == string::npos)
+			continue;
+
+		json jsonData = json::parse(line, nullptr, false);
+		if (jsonData.is_discarded())
+			throw RobinhoodException("QuoteReplay::import_json_lines(): " + jsonPath + ":" + to_string(lineNumber) + " is not valid JSON");
+
+		auto results = jsonData.find("results");
+		if (results != jsonData.end() && results->is_array()) {
+			for (const json &jsonQuote : *results)
+				import(jsonQuote);
+		}
+		else
+			import(jsonData);
+	}
+	return written;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include "records.h"
+#include "tickrecorder.h"
+
+/* QuoteReplay: serves quotes from recorded tick files instead of the network.  Records are
+   applied in file order & the latest quote of each symbol is served.
+     WALL_CLOCK           recorded time advances with real time from the first record
+     ACCELERATED          as WALL_CLOCK, speed times faster
+     AS_FAST_AS_POSSIBLE  every quote request of a symbol advances to that symbol's next record
+   Pass it to the RobinhoodTrader constructor to replay through the usual quote methods.  In
+   AS_FAST_AS_POSSIBLE mode its quote requests & ask_price() step the symbol; bid_price(),
+   ask_size() & bid_size() read the record reached, so a loop reading ask then bid advances one
+   record per pass & both prices come from it.
+   Thread safe.
+*/
+class QuoteReplay {
+public:
+	enum Mode { WALL_CLOCK, ACCELERATED, AS_FAST_AS_POSSIBLE };
+
+	//files: tick files in replay order, e.g. consecutive days.
+	explicit QuoteReplay(const std::vector<std::string> &files, Mode mode = AS_FAST_AS_POSSIBLE, double speed = 1.0);
+
+	QuoteReplay(const QuoteReplay &) = delete;
+	QuoteReplay &operator=(const QuoteReplay &) = delete;
+
+	//get_quote(): Current quote of symbol (upper case). Throws RobinhoodException if it has none yet.
+	Quote get_quote(const std::string &symbol);
+	//quote(): As get_quote() without throwing. Returns false if the symbol has no quote yet.
+	bool quote(SymbolId symbol, Quote &quote);
+	//current(): As quote() but never steps to the symbol's next record, so repeated reads agree.
+	//The clock modes still catch up with the clock.
+	bool current(SymbolId symbol, Quote &quote);
+
+	//rewind(): Back to the first record; the clock restarts.
+	void rewind();
+	bool finished() const;
+	//now(): Recorded time reached, microseconds since epoch.
+	int64_t now() const;
+	uint64_t replayed() const;
+	Mode mode() const { return replayMode; }
+
+	/* import_json_lines(): Convert a file of quote_data() outputs, one JSON document per line
+	   (a quote or a {"results": [...]} batch), into day partitioned tick files in directory.
+	   Quotes are stamped with their updated_at; repeats of an unchanged quote are skipped.
+	   Returns the number of records written.
+	*/
+	static uint64_t import_json_lines(const std::string &jsonPath, const std::string &directory);
+
+private:
+	void apply(const TickReader &reader, const TickRecord &record);
+	bool step();
+	void advance_to(int64_t timestamp);
+	void advance_symbol(SymbolId symbol);
+	void sync_clock();
+	bool latest_of(SymbolId symbol, Quote &quote) const;
+
+	std::vector<std::unique_ptr<TickReader>> readers;
+	Mode replayMode;
+	double speed;
+
+	mutable std::mutex replay_mutex;
+	std::size_t fileIndex;
+	std::size_t recordIndex;
+	int64_t replayTime;
+	uint64_t replayCount;
+	int64_t firstTimestamp;
+	std::chrono::steady_clock::time_point started;
+	std::vector<Quote> latest;      //indexed by SymbolId, symbol 0 if none yet
+	std::vector<bool> exhausted;    //indexed by SymbolId, no records left after the cursor
+};
@@ -0,0 +1,357 @@
+/* recordparser.cpp: converts Robinhood API objects into the typed records */
+
+#include <cstdio>
+
+#include "recordparser.h"
+#include "endpoints.h"
+#include "ordertemplate.h"
+
+using namespace std;
+
+//key_is(): Compare a key of known length with a literal.
+template <size_t N>
+static inline bool key_is(const char *key, size_t keyLen, const char (&literal)[N]) {
+	return keyLen == N - 1 && memcmp(key, literal, N - 1) == 0;
+}
+
+static inline int digits(const char *text, size_t count) {
+	int value = 0;
+	for (size_t i = 0; i < count; i++)
+		value = value * 10 + (text[i] - '0');
+	return value;
+}
+
+bool parse_price(const char *text, size_t len, Price &price) {
+	price.ticks = 0;
+	if (!text || len == 0)
+		return false;
+
+	size_t i = 0;
+	bool negative = false;
+	if (text[i] == '-' || text[i] == '+') {
+		negative = text[i] == '-';
+		i++;
+	}
+
+	int64_t whole = 0;
+	bool any = false;
+	for (; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+		whole = whole * 10 + (text[i] - '0');
+		any = true;
+	}
+
+	int64_t fraction = 0;
+	int64_t unit = price_scale;
+	bool roundUp = false;
+	if (i < len && text[i] == '.') {
+		for (i++; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+			if (unit > 1) {
+				unit /= 10;
+				fraction += (text[i] - '0') * unit;
+			}
+			else if (unit == 1) {
+				//First digit past the 4th decimal decides rounding.
+				roundUp = text[i] >= '5';
+				unit = 0;
+			}
+			any = true;
+		}
+	}
+	if (!any || i != len)
+		return false;
+
+	int64_t ticks = whole * price_scale + fraction + (roundUp ? 1 : 0);
+	price.ticks = negative ? -ticks : ticks;
+	return true;
+}
+
+//days_from_civil(): Days since 1970-01-01 of a proleptic Gregorian date.
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned mp = m > 2 ? m - 3 : m + 9;
+	const unsigned doy = (153 * mp + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+//civil_from_days(): Inverse of days_from_civil().
+static void civil_from_days(int64_t z, int64_t &y, unsigned &m, unsigned &d) {
+	z += 719468;
+	const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned doe = static_cast<unsigned>(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+int64_t parse_timestamp(const char *text, size_t len) {
+	//Minimum: YYYY-MM-DDTHH:MM:SS
+	if (!text || len < 19)
+		return 0;
+
+	int64_t days = days_from_civil(digits(text, 4), digits(text + 5, 2), digits(text + 8, 2));
+	int64_t seconds = days * 86400 + digits(text + 11, 2) * 3600 + digits(text + 14, 2) * 60 + digits(text + 17, 2);
+
+	size_t i = 19;
+	int64_t micros = 0;
+	if (i < len && text[i] == '.') {
+		int64_t unit = 100000;
+		for (i++; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+			micros += (text[i] - '0') * unit;
+			unit /= 10;
+		}
+	}
+
+	if (i + 6 <= len && (text[i] == '+' || text[i] == '-')) {
+		int offset = digits(text + i + 1, 2) * 3600 + digits(text + i + 4, 2) * 60;
+		seconds -= text[i] == '+' ? offset : -offset;
+	}
+	return seconds * 1000000 + micros;
+}
+
+string format_timestamp(int64_t micros) {
+	int64_t seconds = micros / 1000000, fraction = micros % 1000000;
+	if (fraction < 0) {
+		fraction += 1000000;
+		seconds--;
+	}
+	int64_t days = seconds / 86400, secondOfDay = seconds % 86400;
+	if (secondOfDay < 0) {
+		secondOfDay += 86400;
+		days--;
+	}
+	int64_t year;
+	unsigned month, day;
+	civil_from_days(days, year, month, day);
+
+	char text[40];
+	snprintf(text, sizeof(text), "%04lld-%02u-%02uT%02d:%02d:%02d.%06lldZ", (long long)year, month, day,
+			int(secondOfDay / 3600), int(secondOfDay / 60 % 60), int(secondOfDay % 60), (long long)fraction);
+	return text;
+}
+
+void parse_instrument_id(const char *url, size_t len, RobinhoodId &id) {
+	if (!url) {
+		id.clear();
+		return;
+	}
+	if (len > 0 && url[len - 1] == '/')
+		len--;
+	size_t start = len;
+	while (start > 0 && url[start - 1] != '/')
+		start--;
+	id.assign(url + start, len - start);
+}
+
+string instrument_url(const RobinhoodId &id) {
+	return instruments_url + id.data + "/";
+}
+
+static OrderState parse_order_state(const char *value, size_t len) {
+	if (key_is(value, len, "queued")) return QUEUED;
+	if (key_is(value, len, "unconfirmed")) return UNCONFIRMED;
+	if (key_is(value, len, "confirmed")) return CONFIRMED;
+	if (key_is(value, len, "partially_filled")) return PARTIALLY_FILLED;
+	if (key_is(value, len, "filled")) return FILLED;
+	if (key_is(value, len, "cancelled")) return CANCELLED;
+	if (key_is(value, len, "rejected")) return REJECTED;
+	if (key_is(value, len, "failed")) return FAILED;
+	return UNKNOWN_STATE;
+}
+
+static uint32_t parse_size(const char *value, size_t len) {
+	//Sizes are integers but may be sent as "100" or 100.0
+	Price size;
+	if (!parse_price(value, len, size) || size.ticks < 0)
+		return 0;
+	return static_cast<uint32_t>(size.ticks / price_scale);
+}
+
+void assign_quote_field(Quote &quote, const char *key, size_t keyLen, const char *value, size_t len) {
+	if (!value)
+		return;
+	if (key_is(key, keyLen, "ask_price")) parse_price(value, len, quote.ask_price);
+	else if (key_is(key, keyLen, "bid_price")) parse_price(value, len, quote.bid_price);
+	else if (key_is(key, keyLen, "ask_size")) quote.ask_size = parse_size(value, len);
+	else if (key_is(key, keyLen, "bid_size")) quote.bid_size = parse_size(value, len);
+	else if (key_is(key, keyLen, "last_trade_price")) parse_price(value, len, quote.last_trade_price);
+	else if (key_is(key, keyLen, "previous_close")) parse_price(value, len, quote.previous_close);
+	else if (key_is(key, keyLen, "trading_halted")) quote.trading_halted = key_is(value, len, "true");
+	else if (key_is(key, keyLen, "updated_at")) quote.updated_at = parse_timestamp(value, len);
+	else if (key_is(key, keyLen, "symbol")) quote.symbol = SymbolTable::instance().intern(value, len);
+	else if (key_is(key, keyLen, "instrument")) parse_instrument_id(value, len, quote.instrument);
+}
+
+void assign_position_field(Position &position, const char *key, size_t keyLen, const char *value, size_t len) {
+	if (!value)
+		return;
+	if (key_is(key, keyLen, "quantity")) parse_price(value, len, position.quantity);
+	else if (key_is(key, keyLen, "average_buy_price")) parse_price(value, len, position.average_buy_price);
+	else if (key_is(key, keyLen, "shares_held_for_sells")) parse_price(value, len, position.shares_held_for_sells);
+	else if (key_is(key, keyLen, "updated_at")) position.updated_at = parse_timestamp(value, len);
+	else if (key_is(key, keyLen, "instrument")) parse_instrument_id(value, len, position.instrument);
+}
+
+void assign_order_field(Order &order, const char *key, size_t keyLen, const char *value, size_t len) {
+	if (key_is(key, keyLen, "cancel")) {
+		if (value)
+			order.cancel_url.assign(value, len);
+		else
+			order.cancel_url.clear();
+		return;
+	}
+	if (!value)
+		return;
+	if (key_is(key, keyLen, "id")) order.id.assign(value, len);
+	else if (key_is(key, keyLen, "state")) order.state = parse_order_state(value, len);
+	else if (key_is(key, keyLen, "side")) order.side = key_is(value, len, "sell") ? SELL : BUY;
+	else if (key_is(key, keyLen, "type")) order.type = key_is(value, len, "limit") ? LIMIT : MARKET;
+	else if (key_is(key, keyLen, "trigger")) order.trigger = key_is(value, len, "stop") ? STOP : IMMEDIATE;
+	else if (key_is(key, keyLen, "time_in_force")) order.time_in_force = key_is(value, len, "gtc") ? GTC : GFD;
+	else if (key_is(key, keyLen, "quantity")) parse_price(value, len, order.quantity);
+	else if (key_is(key, keyLen, "cumulative_quantity")) parse_price(value, len, order.cumulative_quantity);
+	else if (key_is(key, keyLen, "price")) parse_price(value, len, order.price);
+	else if (key_is(key, keyLen, "stop_price")) parse_price(value, len, order.stop_price);
+	else if (key_is(key, keyLen, "average_price")) parse_price(value, len, order.average_price);
+	else if (key_is(key, keyLen, "created_at")) order.created_at = parse_timestamp(value, len);
+	else if (key_is(key, keyLen, "updated_at")) order.updated_at = parse_timestamp(value, len);
+	else if (key_is(key, keyLen, "instrument")) parse_instrument_id(value, len, order.instrument);
+}
+
+void assign_account_field(Account &account, const char *key, size_t keyLen, const char *value, size_t len) {
+	if (!value)
+		return;
+	if (key_is(key, keyLen, "account_number")) account.account_number.assign(value, len);
+	else if (key_is(key, keyLen, "buying_power")) parse_price(value, len, account.buying_power);
+	else if (key_is(key, keyLen, "cash")) parse_price(value, len, account.cash);
+	else if (key_is(key, keyLen, "cash_held_for_orders")) parse_price(value, len, account.cash_held_for_orders);
+	else if (key_is(key, keyLen, "unsettled_funds")) parse_price(value, len, account.unsettled_funds);
+}
+
+//assign_fields(): Feed the scalar members of a JSON object to an assign_*_field() function.
+template <typename Record, typename Assign>
+static void assign_fields(Record &record, const json &jsonData, Assign assign) {
+	if (!jsonData.is_object())
+		return;
+	for (auto it = jsonData.begin(); it != jsonData.end(); ++it) {
+		const string &key = it.key();
+		const json &value = it.value();
+		if (value.is_string()) {
+			const string &text = value.get_ref<const string &>();
+			assign(record, key.data(), key.size(), text.data(), text.size());
+		}
+		else if (value.is_number() || value.is_boolean()) {
+			string text = value.dump();
+			assign(record, key.data(), key.size(), text.data(), text.size());
+		}
+	}
+}
+
+Quote parse_quote(const json &jsonData) {
+	Quote quote = {};
+	assign_fields(quote, jsonData, assign_quote_field);
+	return quote;
+}
+
+Position parse_position(const json &jsonData) {
+	Position position = {};
+	assign_fields(position, jsonData, assign_position_field);
+	return position;
+}
+
+Order parse_order(const json &jsonData) {
+	Order order = {};
+	order.state = UNKNOWN_STATE;
+	assign_fields(order, jsonData, assign_order_field);
+	return order;
+}
+
+Account parse_account(const json &jsonData) {
+	Account account = {};
+	assign_fields(account, jsonData, assign_account_field);
+	return account;
+}
+
+static json price_json(Price price, bool nullIfZero = false) {
+	if (nullIfZero && price.ticks == 0)
+		return nullptr;
+	char text[24];
+	return string(text, format_price(price, text));
+}
+
+static const char *order_state_name(OrderState state) {
+	switch (state) {
+	case QUEUED: return "queued";
+	case UNCONFIRMED: return "unconfirmed";
+	case CONFIRMED: return "confirmed";
+	case PARTIALLY_FILLED: return "partially_filled";
+	case FILLED: return "filled";
+	case CANCELLED: return "cancelled";
+	case REJECTED: return "rejected";
+	case FAILED: return "failed";
+	default: return "unknown";
+	}
+}
+
+json quote_json(const Quote &quote) {
+	json jsonData;
+	jsonData["symbol"] = SymbolTable::instance().name(quote.symbol);
+	jsonData["ask_price"] = price_json(quote.ask_price);
+	jsonData["ask_size"] = quote.ask_size;
+	jsonData["bid_price"] = price_json(quote.bid_price);
+	jsonData["bid_size"] = quote.bid_size;
+	jsonData["last_trade_price"] = price_json(quote.last_trade_price);
+	jsonData["previous_close"] = price_json(quote.previous_close);
+	jsonData["trading_halted"] = quote.trading_halted != 0;
+	jsonData["updated_at"] = format_timestamp(quote.updated_at);
+	if (!quote.instrument.empty())
+		jsonData["instrument"] = instrument_url(quote.instrument);
+	return jsonData;
+}
+
+json position_json(const Position &position) {
+	json jsonData;
+	jsonData["instrument"] = position.instrument.empty() ? json(nullptr) : json(instrument_url(position.instrument));
+	jsonData["quantity"] = price_json(position.quantity);
+	jsonData["average_buy_price"] = price_json(position.average_buy_price);
+	jsonData["shares_held_for_sells"] = price_json(position.shares_held_for_sells);
+	jsonData["updated_at"] = format_timestamp(position.updated_at);
+	return jsonData;
+}
+
+json order_json(const Order &order) {
+	json jsonData;
+	jsonData["id"] = order.id.str();
+	jsonData["url"] = orders_url + order.id.data + "/";
+	jsonData["cancel"] = order.cancel_url.empty() ? json(nullptr) : json(order.cancel_url.str());
+	jsonData["instrument"] = order.instrument.empty() ? json(nullptr) : json(instrument_url(order.instrument));
+	jsonData["side"] = order.side == SELL ? "sell" : "buy";
+	jsonData["type"] = order.type == LIMIT ? "limit" : "market";
+	jsonData["trigger"] = order.trigger == STOP ? "stop" : "immediate";
+	jsonData["time_in_force"] = order.time_in_force == GTC ? "gtc" : "gfd";
+	jsonData["state"] = order_state_name(order.state);
+	jsonData["quantity"] = price_json(order.quantity);
+	jsonData["cumulative_quantity"] = price_json(order.cumulative_quantity);
+	jsonData["price"] = price_json(order.price, true);
+	jsonData["stop_price"] = price_json(order.stop_price, true);
+	jsonData["average_price"] = price_json(order.average_price, true);
+	jsonData["created_at"] = format_timestamp(order.created_at);
+	jsonData["updated_at"] = format_timestamp(order.updated_at);
+	return jsonData;
+}
+
+json account_json(const Account &account) {
+	json jsonData;
+	jsonData["account_number"] = account.account_number.str();
+	jsonData["url"] = accounts_url + account.account_number.data + "/";
+	jsonData["buying_power"] = price_json(account.buying_power);
+	jsonData["cash"] = price_json(account.cash);
+	jsonData["cash_held_for_orders"] = price_json(account.cash_held_for_orders);
+	jsonData["unsettled_funds"] = price_json(account.unsettled_funds);
+	return jsonData;
+}
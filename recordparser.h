@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <nlohmann/json.hpp>
+#include "records.h"
+
+using json = nlohmann::json;
+
+/* Field level conversions shared by the DOM parsers below & the streaming decoder.
+   Values are the raw JSON scalar text (without quotes); a JSON null is passed as nullptr.
+*/
+
+//parse_price(): Decimal text to fixed-point, rounded to 4 decimal places. Returns false on malformed input.
+bool parse_price(const char *text, std::size_t len, Price &price);
+
+//parse_timestamp(): ISO 8601 time ("2019-03-01T20:59:59.123456Z", "...+00:00") to microseconds since epoch.
+int64_t parse_timestamp(const char *text, std::size_t len);
+
+//format_timestamp(): Inverse of parse_timestamp(), "2019-03-01T20:59:59.123456Z".
+std::string format_timestamp(int64_t micros);
+
+//parse_instrument_id(): Last path segment of an instrument URL.
+void parse_instrument_id(const char *url, std::size_t len, RobinhoodId &id);
+
+//instrument_url(): The URL the API expects for an instrument id.
+std::string instrument_url(const RobinhoodId &id);
+
+//assign_*_field(): Store one key/value of an API object into the record. Unknown keys are ignored.
+void assign_quote_field(Quote &quote, const char *key, std::size_t keyLen, const char *value, std::size_t len);
+void assign_position_field(Position &position, const char *key, std::size_t keyLen, const char *value, std::size_t len);
+void assign_order_field(Order &order, const char *key, std::size_t keyLen, const char *value, std::size_t len);
+void assign_account_field(Account &account, const char *key, std::size_t keyLen, const char *value, std::size_t len);
+
+//Parse records out of an already parsed JSON object.
+Quote parse_quote(const json &jsonData);
+Position parse_position(const json &jsonData);
+Order parse_order(const json &jsonData);
+Account parse_account(const json &jsonData);
+
+//*_json(): Records in the shape the API returns them, e.g. to serve recorded quotes or paper trades.
+json quote_json(const Quote &quote);
+json position_json(const Position &position);
+json order_json(const Order &order);
+json account_json(const Account &account);
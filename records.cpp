@@ -0,0 +1,48 @@
+/* records.cpp: symbol interning for the typed records */
+
+#include "records.h"
+#include "exceptions.h"
+
+using namespace std;
+
+SymbolTable::SymbolTable() {
+	//Id 0 is reserved for "no symbol".
+	names.push_back("");
+}
+
+SymbolTable &SymbolTable::instance() {
+	static SymbolTable table;
+	return table;
+}
+
+//intern(): Returns the id of symbol, assigning the next free id the first time it is seen.
+SymbolId SymbolTable::intern(const char *symbol, size_t len) {
+	string key(symbol, len);
+	lock_guard<mutex> lock(table_mutex);
+	auto it = ids.find(key);
+	if (it != ids.end())
+		return it->second;
+
+	SymbolId id = static_cast<SymbolId>(names.size());
+	names.push_back(key);
+	ids.emplace(std::move(key), id);
+	return id;
+}
+
+SymbolId SymbolTable::find(const string &symbol) const {
+	lock_guard<mutex> lock(table_mutex);
+	auto it = ids.find(symbol);
+	return it == ids.end() ? 0 : it->second;
+}
+
+const string &SymbolTable::name(SymbolId id) const {
+	lock_guard<mutex> lock(table_mutex);
+	if (id >= names.size())
+		throw RobinhoodException("SymbolTable::name(): Unknown symbol id " + to_string(id));
+	return names[id];
+}
+
+size_t SymbolTable::size() const {
+	lock_guard<mutex> lock(table_mutex);
+	return names.size();
+}
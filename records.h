@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+enum Trigger {IMMEDIATE, STOP};
+enum OrderType {MARKET, LIMIT};
+enum TimeInForce {GFD, GTC };
+enum Side {BUY, SELL };
+enum OrderState {QUEUED, UNCONFIRMED, CONFIRMED, PARTIALLY_FILLED, FILLED, CANCELLED, REJECTED, FAILED, UNKNOWN_STATE};
+
+//Prices & share quantities are fixed-point decimals with 4 decimal places (1 tick = 0.0001).
+const int64_t price_scale = 10000;
+
+struct Price {
+	int64_t ticks;
+
+	double to_double() const { return double(ticks) / price_scale; }
+	static Price from_double(double value) {
+		Price p;
+		p.ticks = int64_t(value * price_scale + (value < 0 ? -0.5 : 0.5));
+		return p;
+	}
+};
+
+inline bool operator==(Price a, Price b) { return a.ticks == b.ticks; }
+inline bool operator!=(Price a, Price b) { return a.ticks != b.ticks; }
+inline bool operator<(Price a, Price b) { return a.ticks < b.ticks; }
+
+//FixedString: NUL terminated string stored inline so records stay trivially copyable.
+template <std::size_t N>
+struct FixedString {
+	char data[N];
+
+	void assign(const char *s, std::size_t len) {
+		if (len > N - 1)
+			len = N - 1;
+		std::memcpy(data, s, len);
+		data[len] = '\0';
+	}
+	void assign(const std::string &s) { assign(s.data(), s.size()); }
+	void clear() { data[0] = '\0'; }
+	bool empty() const { return data[0] == '\0'; }
+	std::string str() const { return std::string(data); }
+};
+
+//Robinhood ids (orders, instruments) are 36 character UUIDs.
+typedef FixedString<40> RobinhoodId;
+
+//SymbolId: interned ticker symbol. 0 means "no symbol".
+typedef uint32_t SymbolId;
+
+/* SymbolTable: Interns ticker symbols into small dense ids so records can carry a symbol
+   without a std::string.  Ids are never reused & names stay valid for the process lifetime.
+*/
+class SymbolTable {
+public:
+	static SymbolTable &instance();
+
+	SymbolId intern(const char *symbol, std::size_t len);
+	SymbolId intern(const std::string &symbol) { return intern(symbol.data(), symbol.size()); }
+	//find(): Id of an already interned symbol, 0 if unknown.
+	SymbolId find(const std::string &symbol) const;
+	const std::string &name(SymbolId id) const;
+	std::size_t size() const;
+
+private:
+	SymbolTable();
+
+	mutable std::mutex table_mutex;
+	std::unordered_map<std::string, SymbolId> ids;
+	std::deque<std::string> names;
+};
+
+struct Quote {
+	SymbolId symbol;
+	uint32_t bid_size;
+	uint32_t ask_size;
+	uint32_t trading_halted;
+	Price bid_price;
+	Price ask_price;
+	Price last_trade_price;
+	Price previous_close;
+	int64_t updated_at;        //microseconds since epoch
+	RobinhoodId instrument;
+};
+
+struct Position {
+	SymbolId symbol;           //0 unless resolved from the instrument
+	uint32_t reserved;
+	Price quantity;
+	Price average_buy_price;
+	Price shares_held_for_sells;
+	int64_t updated_at;
+	RobinhoodId instrument;
+};
+
+struct Order {
+	RobinhoodId id;
+	RobinhoodId instrument;
+	SymbolId symbol;           //0 unless resolved from the instrument
+	Side side;
+	OrderType type;
+	Trigger trigger;
+	TimeInForce time_in_force;
+	OrderState state;
+	Price quantity;
+	Price cumulative_quantity;
+	Price price;
+	Price stop_price;
+	Price average_price;
+	int64_t created_at;
+	int64_t updated_at;
+	FixedString<96> cancel_url;  //empty once the order can no longer be cancelled
+};
+
+struct Account {
+	FixedString<16> account_number;
+	Price buying_power;
+	Price cash;
+	Price cash_held_for_orders;
+	Price unsettled_funds;
+};
@@ -0,0 +1,238 @@
+/* requestengine.cpp: curl_multi based engine for running HTTP requests concurrently */
+
+#include "requestengine.h"
+#include "exceptions.h"
+
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+static size_t engine_write_callback(const char *in, size_t size, size_t num, string *out) {
+	const size_t totalBytes(size * num);
+	out->append(in, totalBytes);
+	return totalBytes;
+}
+
+//parse_json_response(): Checks the http status & parses body as JSON.
+unique_ptr<json> parse_json_response(const string &caller, const string &url, long httpCode, const string &body) {
+	if ((httpCode != 200) and (httpCode != 201))
+		throw RobinhoodException(caller + ": Couldn't GET from " + url + " - exiting." + "\nError Msg:" + body + "\nhttpCode: " + to_string(httpCode));
+
+	unique_ptr<json> jsonData(new json);
+	try
+	{
+		*jsonData = json::parse(body);
+	}
+	catch (const json::parse_error &e)
+	{
+		throw RobinhoodException(caller + ": Could not parse HTTP data as JSON. Error message: " + string(e.what()) +
+								"\nHTTP data was:\n" + body);
+	}
+	return jsonData;
+}
+
+RequestEngine::RequestEngine(HeaderList headers, const TransportProfile &profile, CURLSH *share, LatencyStats *stats)
+	: headers(headers), profile(profile), share(share), stats(stats), stopping(false) {
+
+	multi = curl_multi_init();
+	if (!multi)
+		throw RobinhoodException("RequestEngine(): Could not initialize curl multi handle");
+
+	configure_multi(multi, profile);
+
+	loop = thread(&RequestEngine::run, this);
+}
+
+RequestEngine::~RequestEngine() {
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	curl_multi_wakeup(multi);
+	loop.join();
+
+	for (CURL *easy : idle_handles)
+		curl_easy_cleanup(easy);
+	curl_multi_cleanup(multi);
+}
+
+void RequestEngine::set_headers(HeaderList headers) {
+	lock_guard<mutex> lock(queue_mutex);
+	this->headers = headers;
+}
+
+//submit(): Queue a request; callback runs on the event loop thread once it completes.
+void RequestEngine::submit(HttpRequest request, Callback callback) {
+	unique_ptr<Transfer> transfer(new Transfer());
+	transfer->easy = nullptr;
+	transfer->request = std::move(request);
+	transfer->response.result = CURLE_OK;
+	transfer->response.httpCode = 0;
+	transfer->callback = std::move(callback);
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		if (stopping)
+			throw RobinhoodException("RequestEngine::submit(): Engine is shutting down");
+		pending.push_back(std::move(transfer));
+	}
+	curl_multi_wakeup(multi);
+}
+
+//submit(): Queue a request; the future yields the parsed JSON response (or its selected part) or the error.
+future<json> RequestEngine::submit(HttpRequest request, Selector select) {
+	auto promise = make_shared<std::promise<json>>();
+	auto result = promise->get_future();
+	string url = request.url;
+
+	LatencyStats *stats = this->stats;
+
+	submit(std::move(request), [promise, url, select, stats](HttpResponse &response) {
+		try {
+			if (response.result != CURLE_OK)
+				throw RobinhoodException("RequestEngine: request to " + url + " failed. Error Msg: " + string(curl_easy_strerror(response.result)));
+			auto parseStart = chrono::steady_clock::now();
+			unique_ptr<json> jsonData = parse_json_response("RequestEngine", url, response.httpCode, response.body);
+			if (stats)
+				stats->record_parse(url, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - parseStart).count());
+			if (select)
+				promise->set_value(select(*jsonData));
+			else
+				promise->set_value(std::move(*jsonData));
+		}
+		catch (...) {
+			promise->set_exception(current_exception());
+		}
+	});
+	return result;
+}
+
+//connect(): Any HTTP response means the connection (DNS, TCP & TLS) is up & pooled.
+future<void> RequestEngine::connect(const string &url) {
+	auto promise = make_shared<std::promise<void>>();
+	auto result = promise->get_future();
+
+	submit(HttpRequest{ HttpMethod::HEAD, url, "" }, [promise, url](HttpResponse &response) {
+		if (response.result == CURLE_OK)
+			promise->set_value();
+		else
+			promise->set_exception(make_exception_ptr(RobinhoodException("RequestEngine::connect(): Could not connect to " + url +
+				". Error Msg: " + string(curl_easy_strerror(response.result)))));
+	});
+	return result;
+}
+
+//run(): Event loop. Starts queued transfers, drives the multi handle & dispatches completions.
+void RequestEngine::run() {
+	for (;;) {
+		deque<unique_ptr<Transfer>> starting;
+		{
+			lock_guard<mutex> lock(queue_mutex);
+			if (stopping)
+				break;
+			starting.swap(pending);
+		}
+		for (auto &transfer : starting)
+			start_transfer(std::move(transfer));
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		CURLMsg *msg;
+		int queued = 0;
+		while ((msg = curl_multi_info_read(multi, &queued)) != nullptr) {
+			if (msg->msg == CURLMSG_DONE)
+				complete_transfer(msg->easy_handle, msg->data.result);
+		}
+
+		curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+	}
+
+	//Fail whatever is still queued or in flight.
+	for (auto &transfer : pending) {
+		transfer->response.result = CURLE_ABORTED_BY_CALLBACK;
+		notify(*transfer);
+	}
+	pending.clear();
+
+	vector<CURL *> inFlight(active_handles.begin(), active_handles.end());
+	for (CURL *easy : inFlight)
+		complete_transfer(easy, CURLE_ABORTED_BY_CALLBACK);
+}
+
+void RequestEngine::start_transfer(unique_ptr<Transfer> transfer) {
+	CURL *easy;
+	if (!idle_handles.empty()) {
+		easy = idle_handles.front();
+		idle_handles.pop_front();
+		curl_easy_reset(easy);
+	}
+	else
+		easy = curl_easy_init();
+
+	if (!easy) {
+		transfer->response.result = CURLE_FAILED_INIT;
+		notify(*transfer);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		transfer->session_headers = headers;
+	}
+
+	configure_handle(easy, transfer->request.headers ? transfer->request.headers : transfer->session_headers.get(), profile, share);
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, engine_write_callback);
+
+	if (profile.redirected())
+		transfer->request.url = route_url(transfer->request.url, profile);
+	curl_easy_setopt(easy, CURLOPT_URL, transfer->request.url.c_str());
+	if (transfer->request.method == HttpMethod::POST) {
+		curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long)transfer->request.body.size());
+		curl_easy_setopt(easy, CURLOPT_POSTFIELDS, transfer->request.body.c_str());
+	}
+	else if (transfer->request.method == HttpMethod::HEAD)
+		curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+	else
+		curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+
+	transfer->easy = easy;
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->response.body);
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+
+	if (curl_multi_add_handle(multi, easy) != CURLM_OK) {
+		transfer->response.result = CURLE_FAILED_INIT;
+		idle_handles.push_back(easy);
+		notify(*transfer);
+		return;
+	}
+	//Owned by the multi handle (through CURLOPT_PRIVATE) until complete_transfer().
+	active_handles.insert(easy);
+	transfer.release();
+}
+
+void RequestEngine::complete_transfer(CURL *easy, CURLcode result) {
+	Transfer *raw = nullptr;
+	curl_easy_getinfo(easy, CURLINFO_PRIVATE, &raw);
+	unique_ptr<Transfer> transfer(raw);
+
+	curl_multi_remove_handle(multi, easy);
+	active_handles.erase(easy);
+
+	transfer->response.result = result;
+	curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->response.httpCode);
+	if (stats)
+		stats->record_transfer(transfer->request.url, easy, result);
+	idle_handles.push_back(easy);
+
+	notify(*transfer);
+}
+
+//notify(): Report a finished transfer to its callback. A throwing callback must not take down the event loop.
+void RequestEngine::notify(Transfer &transfer) {
+	try {
+		transfer.callback(transfer.response);
+	}
+	catch (...) {
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <curl/curl.h>
+#include <string>
+#include <deque>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include "transport.h"
+#include "latencystats.h"
+
+using json = nlohmann::json;
+
+enum class HttpMethod { GET, POST, HEAD };
+
+/* HttpRequest: everything one request needs, so no option set for an earlier request can leak
+   into it.  A POST sends body as form data.  headers replaces the session's header list for
+   this request only; nullptr keeps the session's.
+*/
+struct HttpRequest {
+	HttpMethod method;
+	std::string url;
+	std::string body;
+	curl_slist *headers = nullptr;
+};
+
+//HttpResponse: outcome of a completed request.  result is the libcurl status of the transfer.
+struct HttpResponse {
+	CURLcode result;
+	long httpCode;
+	std::string body;
+};
+
+//parse_json_response(): Checks the http status & parses body as JSON. Throws RobinhoodException on failure.
+std::unique_ptr<json> parse_json_response(const std::string &caller, const std::string &url, long httpCode, const std::string &body);
+
+/* RequestEngine: Runs many HTTP requests concurrently on a curl_multi handle driven by its own
+   event loop thread.  All requests share the multi handle's connection pool.  Completion is
+   reported through a callback (invoked on the event loop thread) or a future.  The optional
+   selector picks the part of the parsed response the future yields.  When stats is given every
+   transfer's timings are recorded there, & the futures' parse time as well.
+*/
+class RequestEngine {
+public:
+	typedef std::function<void(HttpResponse &)> Callback;
+	typedef std::function<json(json &)> Selector;
+
+	RequestEngine(HeaderList headers, const TransportProfile &profile = TransportProfile(), CURLSH *share = nullptr,
+				LatencyStats *stats = nullptr);
+	~RequestEngine();
+
+	RequestEngine(const RequestEngine &) = delete;
+	RequestEngine &operator=(const RequestEngine &) = delete;
+
+	//set_headers(): Headers used for requests started from now on. Running ones keep theirs alive.
+	void set_headers(HeaderList headers);
+	LatencyStats *latency_stats() const { return stats; }
+
+	void submit(HttpRequest request, Callback callback);
+	std::future<json> submit(HttpRequest request, Selector select = nullptr);
+
+	//connect(): Open a connection to url's host ahead of time. The future fails if it couldn't connect.
+	std::future<void> connect(const std::string &url);
+
+private:
+	struct Transfer {
+		CURL *easy;
+		HttpRequest request;
+		HeaderList session_headers;        //pins the session's list while the transfer runs
+		HttpResponse response;
+		Callback callback;
+	};
+
+	void run();
+	void start_transfer(std::unique_ptr<Transfer> transfer);
+	void complete_transfer(CURL *easy, CURLcode result);
+	void notify(Transfer &transfer);
+
+	CURLM *multi;
+	HeaderList headers;
+	TransportProfile profile;
+	CURLSH *share;
+	LatencyStats *stats;
+	std::deque<std::unique_ptr<Transfer>> pending;
+	std::deque<CURL *> idle_handles;
+	std::unordered_set<CURL *> active_handles;
+	std::mutex queue_mutex;
+	bool stopping;
+	std::thread loop;
+};
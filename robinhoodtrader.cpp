@@ -4,17 +4,62 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cstring>
+#include <chrono>
 
 #include "robinhoodtrader.h"
 #include "endpoints.h"
 #include "exceptions.h"
+#include "recordparser.h"
 #include "authentication/authentication.h"
+#include "logger.h"
 
 using namespace std;
 
 const string clientId = "c82SH0WZOsabOXGP2sxqcj34FxkvfnWRZBKlBjFS";    
 
-RobinhoodTrader::RobinhoodTrader() {
+//Maximum number of symbols sent in a single /quotes/?symbols= request.
+const size_t maxQuoteBatchSize = 100;
+//Clock skew between us & the broker allowed for when order syncing starts at login (microseconds).
+const int64_t orderSyncSkew = 60LL * 1000000;
+//Finished orders stay in tracked_orders this long after the newest update synced (microseconds).
+const int64_t finishedOrderRetention = 3600LL * 1000000;
+
+//ready(): A future already holding value, for answers that need no request.
+template <typename T>
+static future<T> ready(T value) {
+	promise<T> result;
+	result.set_value(std::move(value));
+	return result.get_future();
+}
+
+static int64_t now_micros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//upper_symbol(): Ticker symbols are interned & cached in upper case.
+static string upper_symbol(const string &symbol) {
+	string upper(symbol);
+	std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+	return upper;
+}
+
+//session_from_response(): Tokens & expiry of an /oauth2/token/ response.
+static OAuthSession session_from_response(const json &response) {
+	OAuthSession session;
+	session.access_token = response["access_token"].get<string>();
+	if (response.find("refresh_token") != response.end())
+		session.refresh_token = response["refresh_token"].get<string>();
+	auto expiresIn = response.find("expires_in");
+	if (expiresIn != response.end() && expiresIn->is_number())
+		session.expires_at = now_micros() + expiresIn->get<int64_t>() * 1000000;
+	return session;
+}
+
+RobinhoodTrader::RobinhoodTrader(const TransportProfile &profile, shared_ptr<SharedTransport> shared,
+								 shared_ptr<InstrumentCache> instruments)
+	: profile(profile), shared(shared), instruments(instruments ? instruments : make_shared<InstrumentCache>()),
+	  cached_quotes([this](const string &stock) { return get_quote(stock); }) {
 	
 	//Create a curl handle 
 	curl = curl_easy_init();
@@ -23,54 +68,171 @@ RobinhoodTrader::RobinhoodTrader() {
 		throw RobinhoodException("RobinhoodTrader(): Could not initialize curl");
 
 	//Set headers
-	headers =NULL;
-	headers = curl_slist_append(headers, "Accept: */*");
-	headers = curl_slist_append(headers, "Accept-Encoding: gzip, deflate");
-	headers = curl_slist_append(headers, "Accept-Language: en;q=1, fr;q=0.9, de;q=0.8, ja;q=0.7, nl;q=0.6, it;q=0.5");
-	headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded; charset=utf-8");
-	headers = curl_slist_append(headers, "X-Robinhood-API-Version: 1.0.0");
-	headers = curl_slist_append(headers, "charsets: utf-8");
-	headers = curl_slist_append(headers, "Connection: keep-alive");
-	headers = curl_slist_append(headers, "User-Agent: Robinhood/823 (iPhone; iOS 7.1.2; Scale/2.00)");
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-	///Set properties
-	// Don't bother trying IPv6, which would increase DNS resolution time.
-	curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-
-	// Don't wait forever, time out after 15 seconds.
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 15);
-
-	// Follow HTTP redirects if necessary.
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-	//libcurl picks the one the server supports.
-	curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
+	handle_headers = NULL;
+	handle_method = HttpMethod::GET;
+	handle_streaming = false;
+	install_headers("");
+
+	///Set properties: headers, timeouts, keepalive, DNS caching & the shared DNS/TLS session caches
+	if (profile.share_handles && !this->shared)
+		this->shared = make_shared<SharedTransport>();
+	CURLSH *share = this->shared ? this->shared->handle() : nullptr;
+	configure_handle(curl, headers.get(), profile, share);
+	handle_headers = headers.get();
+	handle_list = headers;
 
 	// Set callback function to process/store data.
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
 
-	//Display curl & libz version info
+	account_cached = false;
+	follower = false;
+	orders_synced_until = 0;
+
+	poller.reset(new QuotePoller([this](const vector<string> &stocks) { return get_quotes(stocks); }));
+	tokens.reset(new TokenManager([this](const OAuthSession &current) { return refresh_session(current); },
+								  [this](const OAuthSession &session) { install_session(session); }));
+	ledger.reset(new PositionLedger([this](PositionLedger &) { return reconcile_positions(); }));
+	tracked_orders.add_listener([this](const Order &previous, const Order &current) { ledger->on_order(previous, current); });
+
+	//Engines for concurrent requests & orders; share our headers.
+	engine.reset(new RequestEngine(headers, profile, share, &latency));
+	gateway.reset(new OrderGateway(headers, profile, share, &latency));
+
+	//Log curl & libz version info
 	auto data = curl_version_info(CURLVERSION_NOW);
-	if (data->version)
-		cout << "curl_version_info: " << data->version << " ";
-	else cout << "curl_version_info: version: null" ;
-	
-	if (data->libz_version)
-		cout << " libz_version: "  << data->libz_version << endl;
-	else
-		cout << " libz_version: null" << endl;
+	RH_LOG(LOG_INFO, "curl_version_info: {} libz_version: {}", data->version ? data->version : "null",
+		data->libz_version ? data->libz_version : "null");
+
+	if (profile.warm_up && !warm_up())
+		RH_LOG(LOG_WARNING, "RobinhoodTrader(): warm_up() could not connect to {}", api_url);
+}
+
+RobinhoodTrader::RobinhoodTrader(shared_ptr<QuoteReplay> replay, const TransportProfile &profile)
+	: RobinhoodTrader(profile) {
+	if (!replay)
+		throw RobinhoodException("RobinhoodTrader(): replay is null");
+	this->replay = replay;
+}
+
+RobinhoodTrader::RobinhoodTrader(shared_ptr<PaperExchange> paper, shared_ptr<QuoteReplay> replay, const TransportProfile &profile)
+	: RobinhoodTrader(profile) {
+	if (!paper)
+		throw RobinhoodException("RobinhoodTrader(): paper exchange is null");
+	this->paper = paper;
+	this->replay = replay;
+}
 
+//warm_up(): Pre-connect the blocking handle & both request engines so the first real request skips DNS, TCP & TLS setup.
+bool RobinhoodTrader::warm_up() {
+	string url = api_url + "/";
+	future<void> engineConnected = engine->connect(url);
+	future<void> gatewayConnected = gateway->connect(url);
+
+	bool connected = true;
+	{
+		lock_guard<mutex> lock(curl_mutex);
+		try {
+			//Any HTTP response will do, the status is not checked.
+			prepare_handle(HttpMethod::HEAD, url, nullptr, 0, nullptr);
+			string ignored;
+			if (handle_streaming) {
+				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+				handle_streaming = false;
+			}
+			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ignored);
+			connected = curl_easy_perform(curl) == CURLE_OK;
+		}
+		catch (const exception &) {
+			connected = false;
+		}
+	}
+
+	for (future<void> *pending : { &engineConnected, &gatewayConnected }) {
+		try {
+			pending->get();
+		}
+		catch (const exception &) {
+			connected = false;
+		}
+	}
+	return connected;
+}
+
+RobinhoodTrader::~RobinhoodTrader() {
+	//Stop the token refresher, reconciler, poller & engines first, their transfers use our headers.
+	tokens.reset();
+	ledger->stop();
+	poller.reset();
+	gateway.reset();
+	engine.reset();
+	curl_easy_cleanup(curl);
 }
 
 //submit_curl_request(): Sends HTTP POST/GET command to Robinhood & returns the response.
-unique_ptr<json> RobinhoodTrader::submit_curl_request( const string &url) {
-	int httpCode(0);    //http response code
+unique_ptr<json> RobinhoodTrader::submit_curl_request(const HttpRequest &request) {
+	lock_guard<mutex> lock(curl_mutex);
+	prepare_handle(request.method, request.url, request.body.data(), request.body.size(), request.headers);
+	return perform_request(request.url);
+}
+
+unique_ptr<json> RobinhoodTrader::submit_curl_request(const string &url) {
+	return submit_curl_request(HttpRequest{ HttpMethod::GET, url, "" });
+}
+
+void RobinhoodTrader::submit_curl_request(const HttpRequest &request, JsonStreamHandler &handler) {
+	lock_guard<mutex> lock(curl_mutex);
+	prepare_handle(request.method, request.url, request.body.data(), request.body.size(), request.headers);
+	perform_request(request.url, handler);
+}
+
+void RobinhoodTrader::submit_curl_request(const string &url, JsonStreamHandler &handler) {
+	submit_curl_request(HttpRequest{ HttpMethod::GET, url, "" }, handler);
+}
+
+/* prepare_handle(): Configure the blocking handle for exactly this request.  Options are per
+   request (method, body, headers) and only re-set when they differ from what the handle has.
+*/
+void RobinhoodTrader::prepare_handle(HttpMethod method, const string &url, const char *body, size_t bodyLen, curl_slist *requestHeaders) {
+	//libcurl copies the URL, the routed one may be a temporary.
+	curl_easy_setopt(curl, CURLOPT_URL, profile.redirected() ? route_url(url, profile).c_str() : url.c_str());
+
+	curl_slist *wanted = requestHeaders ? requestHeaders : headers.get();
+	if (wanted != handle_headers) {
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, wanted);
+		handle_headers = wanted;
+		handle_list = requestHeaders ? nullptr : headers;
+	}
+
+	switch (method) {
+	case HttpMethod::POST:
+		if (handle_method == HttpMethod::HEAD)
+			curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+		//The body belongs to the caller's request; always point the handle at it.
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)bodyLen);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body ? body : "");
+		break;
+	case HttpMethod::HEAD:
+		if (handle_method != HttpMethod::HEAD)
+			curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+		break;
+	case HttpMethod::GET:
+		//HTTPGET also clears NOBODY.
+		if (handle_method != HttpMethod::GET)
+			curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+		break;
+	}
+	handle_method = method;
+}
+
+//perform_request(): Run the prepared request & parse the response as JSON.
+unique_ptr<json> RobinhoodTrader::perform_request(const string &url) {
+	long httpCode(0);    //http response code
 	unique_ptr<std::string> httpData(new std::string());    //http response data
-	unique_ptr<json> jsonData(new json);      //parsed json response data
 
-	//Set url
-	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	if (handle_streaming) {
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+		handle_streaming = false;
+	}
 
 	// Set data container (will be passed as the last parameter to the callback function).  
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, httpData.get());
@@ -80,32 +242,94 @@ unique_ptr<json> RobinhoodTrader::submit_curl_request( const string &url) {
 
 	// Run our HTTP POST command, capture the HTTP response code.
 	CURLcode res = curl_easy_perform(curl);
+	latency.record_transfer(url, curl, res);
 	if (res != CURLE_OK)
 		throw RobinhoodException("submit_curl_request(): curl_easy_perform() failed. Error Msg: " + string(curl_easy_strerror(res)) );
 
 	//Get http response code
 	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
 
-	if ((httpCode != 200) and (httpCode != 201))
-		throw RobinhoodException("submit_curl_request(): Couldn't GET from " + url + " - exiting."+ "\nError Msg:"+ *httpData.get() + "\nhttpCode: " + to_string(httpCode) );
+	//Check the response code & extract data as json
+	auto parseStart = chrono::steady_clock::now();
+	unique_ptr<json> jsonData = parse_json_response("submit_curl_request()", url, httpCode, *httpData);
+	latency.record_parse(url, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - parseStart).count());
+	return jsonData;
 
-	//Extract data as json
-	try
-	{
-		*jsonData = json::parse(*httpData.get());
+}
+
+//StreamContext: state of a streaming request shared with stream_write_callback()
+struct StreamContext {
+	CURL *curl;
+	JsonStreamParser parser;
+	long httpCode;
+	std::string errorBody;     //body of a non 2xx response, kept for the error message
+	std::exception_ptr error;
+	chrono::steady_clock::duration parseTime;    //spent decoding, as opposed to waiting for bytes
+
+	StreamContext(CURL *curl, JsonStreamHandler &handler)
+		: curl(curl), parser(handler), httpCode(0), parseTime(0) {}
+};
+
+//stream_write_callback(): Feeds response bytes to the JSON decoder as they arrive.
+static size_t stream_write_callback(const char *in, size_t size, size_t num, StreamContext *context) {
+	const size_t totalBytes(size * num);
+	if (context->httpCode == 0)
+		curl_easy_getinfo(context->curl, CURLINFO_RESPONSE_CODE, &context->httpCode);
+
+	if ((context->httpCode != 200) and (context->httpCode != 201)) {
+		context->errorBody.append(in, totalBytes);
+		return totalBytes;
 	}
-	catch (const json::parse_error& e)
-	{
-		throw RobinhoodException("submit_curl_request(): Could not parse HTTP data as JSON. Error message: " + string(e.what()) + 
-								"\nHTTP data was:\n" + string(*httpData.get()) );
+	try {
+		auto start = chrono::steady_clock::now();
+		context->parser.feed(in, totalBytes);
+		context->parseTime += chrono::steady_clock::now() - start;
 	}
-	return jsonData;
+	catch (...) {
+		//Don't let exceptions unwind through libcurl; abort the transfer & rethrow afterwards.
+		context->error = current_exception();
+		return 0;
+	}
+	return totalBytes;
+}
 
+//perform_request(): Run the prepared request & decode the response through handler as it arrives.
+void RobinhoodTrader::perform_request(const string &url, JsonStreamHandler &handler) {
+	StreamContext context(curl, handler);
+
+	if (!handle_streaming) {
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write_callback);
+		handle_streaming = true;
+	}
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
+
+	CURLcode res = curl_easy_perform(curl);
+	latency.record_transfer(url, curl, res);
+
+	if (context.error)
+		rethrow_exception(context.error);
+	if (res != CURLE_OK)
+		throw RobinhoodException("submit_curl_request(): curl_easy_perform() failed. Error Msg: " + string(curl_easy_strerror(res)));
+
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &context.httpCode);
+	if ((context.httpCode != 200) and (context.httpCode != 201))
+		throw RobinhoodException("submit_curl_request(): Couldn't GET from " + url + " - exiting." + "\nError Msg:" + context.errorBody + "\nhttpCode: " + to_string(context.httpCode));
+
+	try {
+		auto start = chrono::steady_clock::now();
+		context.parser.finish();
+		context.parseTime += chrono::steady_clock::now() - start;
+	}
+	catch (const RobinhoodException &e) {
+		throw RobinhoodException("submit_curl_request(): Could not parse HTTP data as JSON from " + url + ". Error message: " + string(e.what()));
+	}
+	latency.record_parse(url, chrono::duration_cast<chrono::microseconds>(context.parseTime).count());
 }
 
 //login(): Send login request & update header with access/refresh tokens.   
 int RobinhoodTrader::login(const string &username, const string &password, const string& qr_code) {
 	RobinhoodAuthentication rh_auth;
+	string deviceToken = rh_auth.generateDeviceToken();
 
 	string  _username = "username=" + username,
 		_password = "&password="+password,
@@ -113,7 +337,7 @@ int RobinhoodTrader::login(const string &username, const string &password, const
 		grant_type = "&grant_type=password",
 		client_id = "&client_id=" + clientId,
 		scope = "&scope=internal",
-		device_token = "&device_token=" + rh_auth.generateDeviceToken();
+		device_token = "&device_token=" + deviceToken;
 
 	//ensure mfa code is six chars
 	stringstream ss;
@@ -123,134 +347,809 @@ int RobinhoodTrader::login(const string &username, const string &password, const
 	string postfields = _username + _password + _qr_code + grant_type + client_id + scope + device_token + mfa_code;
 	//cout << "postfields:" << postfields << endl; 
 
-	//This will set post data & set request type to POST
-	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postfields.c_str() );
-			
-	unique_ptr<json> jsonData = submit_curl_request(login_url);
+	unique_ptr<json> jsonData = submit_curl_request(HttpRequest{ HttpMethod::POST, login_url, postfields });
 	
 	//Update header with access/refresh tokens
 	if (((*jsonData).find("access_token") != (*jsonData).end()) && ((*jsonData).find("refresh_token") != (*jsonData).end())) {
-		rh_auth.auth_token = (*jsonData)["access_token"].get<std::string>();
-		rh_auth.refresh_token = (*jsonData)["refresh_token"].get<std::string>();
-
-		headers = curl_slist_append(headers, ("Authorization: Bearer " + rh_auth.auth_token).c_str() );
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+		OAuthSession session = session_from_response(*jsonData);
+		session.device_token = deviceToken;
+		install_session(session);
+		if (!follower)
+			tokens->set_session(session);
 	}
 	else 
 		throw RobinhoodException("login(): Couldn't get access or refresh token. Json data received: " + (*jsonData).dump());
+
+	//Cache the account for the order builders & start the ledger from the broker's positions,
+	//which already hold the fills of orders older than the session
+	refresh_account();
+	seed_order_sync();
+	if (!follower)
+		ledger->start();
 	return 0;
 }
 
+//install_session(): Authenticate further requests with session's tokens.
+void RobinhoodTrader::install_session(const OAuthSession &session) {
+	{
+		lock_guard<mutex> lock(token_mutex);
+		refresh_token = session.refresh_token;
+	}
+	use_auth_token(session.access_token);
+}
+
+/* refresh_session(): Exchange the refresh token for a new access token.  Runs on the request
+   engine, so the blocking handle stays free for other requests meanwhile.
+*/
+OAuthSession RobinhoodTrader::refresh_session(const OAuthSession &current) {
+	string postfields = "grant_type=refresh_token&refresh_token=" + current.refresh_token + "&client_id=" + clientId +
+						"&scope=internal&expires_in=86400";
+	if (!current.device_token.empty())
+		postfields += "&device_token=" + current.device_token;
+
+	json response = engine->submit(HttpRequest{ HttpMethod::POST, login_url, postfields }).get();
+	if (response.find("access_token") == response.end())
+		throw RobinhoodException("refresh_session(): Couldn't get access token. Json data received: " + response.dump());
+	return session_from_response(response);
+}
+
+bool RobinhoodTrader::restore_session(const string &path, const string &passphrase) {
+	if (!tokens->restore(path, passphrase))
+		return false;
+	//Cache the account for the order builders & start the ledger, as login() does
+	refresh_account();
+	seed_order_sync();
+	if (follower)
+		tokens->stop();
+	else
+		ledger->start();
+	return true;
+}
+
+void RobinhoodTrader::persist_session(const string &path, const string &passphrase) {
+	tokens->persist_to(path, passphrase);
+}
+
+//install_headers(): Build a fresh header list carrying token (none if empty) & switch all handles to it.
+void RobinhoodTrader::install_headers(const string &token) {
+	curl_slist *list = NULL;
+	list = curl_slist_append(list, "Accept: */*");
+	list = curl_slist_append(list, "Accept-Encoding: gzip, deflate");
+	list = curl_slist_append(list, "Accept-Language: en;q=1, fr;q=0.9, de;q=0.8, ja;q=0.7, nl;q=0.6, it;q=0.5");
+	list = curl_slist_append(list, "Content-Type: application/x-www-form-urlencoded; charset=utf-8");
+	list = curl_slist_append(list, "X-Robinhood-API-Version: 1.0.0");
+	list = curl_slist_append(list, "charsets: utf-8");
+	list = curl_slist_append(list, "Connection: keep-alive");
+	list = curl_slist_append(list, "User-Agent: Robinhood/823 (iPhone; iOS 7.1.2; Scale/2.00)");
+	if (!token.empty())
+		list = curl_slist_append(list, ("Authorization: Bearer " + token).c_str());
+	if (!list)
+		throw RobinhoodException("install_headers(): Could not allocate headers");
+
+	//The old list is freed once the blocking handle & the engines' running transfers are done with it.
+	HeaderList fresh = make_header_list(list);
+	{
+		lock_guard<mutex> lock(curl_mutex);
+		headers = fresh;
+	}
+	if (engine)
+		engine->set_headers(fresh);
+	if (gateway)
+		gateway->set_headers(fresh);
+}
+
+//use_auth_token(): Authenticate further requests with token, e.g. one obtained by another trader's login().
+void RobinhoodTrader::use_auth_token(const string &token) {
+	{
+		lock_guard<mutex> lock(token_mutex);
+		auth_token = token;
+	}
+	install_headers(token);
+}
+
+string RobinhoodTrader::get_auth_token() const {
+	lock_guard<mutex> lock(token_mutex);
+	return auth_token;
+}
+
+//adopt_session(): Share the login, cached account & instrument cache of other.
+void RobinhoodTrader::adopt_session(const RobinhoodTrader &other) {
+	if (&other == this)
+		return;
+	string token, refresh;
+	{
+		lock_guard<mutex> otherLock(other.token_mutex);
+		token = other.auth_token;
+		refresh = other.refresh_token;
+	}
+	{
+		lock_guard<mutex> lock(token_mutex);
+		refresh_token = refresh;
+	}
+	use_auth_token(token);
+	//Traders sharing one cache (a session pool's) have nothing to copy.
+	if (instruments != other.instruments)
+		instruments->merge(*other.instruments);
+
+	lock_guard<mutex> lock(account_mutex);
+	lock_guard<mutex> otherLock(other.account_mutex);
+	cached_account = other.cached_account;
+	account_cached = other.account_cached;
+}
+
+void RobinhoodTrader::set_follower(bool follower) {
+	this->follower = follower;
+	if (follower) {
+		tokens->stop();
+		ledger->stop();
+		poller->stop();
+	}
+}
+
 //*******Get Quote, Position & Account Info************************************************
 
 //quote_data(): Get stock quote data
 json RobinhoodTrader::quote_data(const string &stock) {
+	if (replay) {
+		Quote quote = replay->get_quote(upper_symbol(stock));
+		observe_quote(quote);
+		return quote_json(quote);
+	}
+
 	string url = quotes_url + stock + "/";				
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	//Accept-Encoding and automatic decompressing data.
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
 
 	unique_ptr<json> jsonData = submit_curl_request( url);
+	cache_instrument(*jsonData);
+	if (paper)
+		observe_quote(parse_quote(*jsonData));
 	return *jsonData;
 }
 
+//cache_instrument(): Remember the instrument of a quote for later orders
+void RobinhoodTrader::cache_instrument(const json &quote) {
+	auto symbol = quote.find("symbol");
+	auto instrument = quote.find("instrument");
+	if (symbol == quote.end() || instrument == quote.end() || !symbol->is_string() || !instrument->is_string())
+		return;
+
+	const string &url = instrument->get_ref<const string &>();
+	RobinhoodId id;
+	parse_instrument_id(url.data(), url.size(), id);
+	instruments->insert(SymbolTable::instance().intern(symbol->get<string>()), id);
+}
+
+//top_of_book(): Polled quote if fresh, else a cached or coalesced request.  A replay's current
+//record, stepped if step is set or the symbol has none yet.
+Quote RobinhoodTrader::top_of_book(const string &stock, bool step) {
+	string symbol = upper_symbol(stock);
+	Quote quote;
+	if (replay) {
+		if (step || !replay->current(SymbolTable::instance().find(symbol), quote))
+			quote = replay->get_quote(symbol);
+		observe_quote(quote);
+		return quote;
+	}
+	if (poller->running() && poller->read_fresh(SymbolTable::instance().find(symbol), quote))
+		return quote;
+	return cached_quotes.get(symbol);
+}
+
 //ask_price(): Get ask price
 float RobinhoodTrader::ask_price(const string &stock) {
-	float askprice;
-	/*unique_ptr<std::string>*/ 
-	auto jsonData = quote_data(stock);
-	askprice = stof(jsonData["ask_price"].get<std::string>());
-	return askprice;
+	return static_cast<float>(top_of_book(stock, true).ask_price.to_double());
 }
 
 //bid_price(): Get bid price
 float RobinhoodTrader::bid_price(const string &stock) {
-	float bidprice;
-	/*unique_ptr<std::string>*/
-	auto jsonData = quote_data(stock);
-	bidprice = stof(jsonData["bid_price"].get<std::string>());
-	return bidprice;
+	return static_cast<float>(top_of_book(stock).bid_price.to_double());
 }
 
 //ask_size(): Get ask size
 int RobinhoodTrader::ask_size(const string &stock) {
-	int asksize;
-	auto jsonData = quote_data(stock);
-	asksize = stoi(jsonData["ask_size"].get<std::string>());
-	return asksize;
+	return static_cast<int>(top_of_book(stock).ask_size);
 }
 
 //bid_size(): Get bid size
 int RobinhoodTrader::bid_size(const string &stock) {
-	int bidsize;
-	auto jsonData = quote_data(stock);
-	bidsize = stoi(jsonData["bid_size"].get<std::string>());
-	return bidsize;
+	return static_cast<int>(top_of_book(stock).bid_size);
 }
 
-//positions(): Get all the positions.
-json RobinhoodTrader::positions() {
-	json positionsJsonData;
+//quote_data_batch(): Get quote data for many stocks. The multi-symbol requests run concurrently.
+unordered_map<string, json> RobinhoodTrader::quote_data_batch(const vector<string> &stocks) {
+	unordered_map<string, json> quotes;
+	quotes.reserve(stocks.size());
+
+	if (replay) {
+		//Symbols without a recorded quote are left out, as unknown symbols are by the API.
+		for (const string &stock : stocks) {
+			Quote quote;
+			string symbol = upper_symbol(stock);
+			if (replay->quote(SymbolTable::instance().find(symbol), quote)) {
+				observe_quote(quote);
+				quotes[stock] = quote_json(quote);
+			}
+		}
+		return quotes;
+	}
+
+	//The API answers with upper case symbols; results go under the caller's spelling.
+	unordered_map<string, vector<string>> requested;
+	for (const string &stock : stocks)
+		requested[upper_symbol(stock)].push_back(stock);
+
+	vector<future<json>> chunks;
+	for (size_t begin = 0; begin < stocks.size(); begin += maxQuoteBatchSize) {
+		size_t end = std::min(begin + maxQuoteBatchSize, stocks.size());
+
+		string url = quotes_url + "?symbols=";
+		for (size_t i = begin; i < end; i++) {
+			if (i != begin)
+				url += ",";
+			url += stocks[i];
+		}
+		chunks.push_back(engine->submit(HttpRequest{ HttpMethod::GET, url, "" }));
+	}
+
+	for (auto &chunk : chunks) {
+		json jsonData = chunk.get();
+
+		//Unknown symbols come back as null entries in the results array.
+		for (auto &quote : jsonData["results"]) {
+			if (quote.is_null())
+				continue;
+			cache_instrument(quote);
+			if (paper)
+				observe_quote(parse_quote(quote));
+			auto names = requested.find(quote["symbol"].get<string>());
+			if (names == requested.end())
+				continue;
+			for (size_t i = 0; i + 1 < names->second.size(); i++)
+				quotes[names->second[i]] = quote;
+			quotes[names->second.back()] = std::move(quote);
+		}
+	}
+	return quotes;
+}
+
+//ask_price_batch(): Get ask prices for many stocks
+unordered_map<string, float> RobinhoodTrader::ask_price_batch(const vector<string> &stocks) {
+	unordered_map<string, float> askprices;
+	for (auto &quote : quote_data_batch(stocks))
+		askprices[quote.first] = stof(quote.second["ask_price"].get<std::string>());
+	return askprices;
+}
 
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	//Accept Encoding and automatic decompressing data.
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+//bid_price_batch(): Get bid prices for many stocks
+unordered_map<string, float> RobinhoodTrader::bid_price_batch(const vector<string> &stocks) {
+	unordered_map<string, float> bidprices;
+	for (auto &quote : quote_data_batch(stocks))
+		bidprices[quote.first] = stof(quote.second["bid_price"].get<std::string>());
+	return bidprices;
+}
 
-	//unique_ptr<std::string> 
-	unique_ptr<json> jsonData = submit_curl_request(positions_url);
-	positionsJsonData = (*jsonData)["results"];
-	return positionsJsonData;
+//positions(): Get all the positions, every page.
+json RobinhoodTrader::positions() {
+	if (paper)
+		return paper_positions(false);
+	return fetch_results_async(positions_url).get();
 }
 
-//positions_nonzero(): Get open positions.
+//positions_nonzero(): Get open positions, every page.
 json RobinhoodTrader::positions_nonzero() {
-	json positions_nonzeroJsonData;
-	string url = positions_url + "?nonzero=true";
+	if (paper)
+		return paper_positions(true);
+	return fetch_results_async(positions_url + "?nonzero=true").get();
+}
 
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	//Accept Encoding and automatic decompressing data.
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+//*******Pagination************************************************************************
+
+//Upper bound on the pages of one listing, in case a server keeps linking pages forever.
+const size_t maxPages = 100000;
+
+//find_next_link(): The "next" link of a page, found by scanning back from the end of the body
+//where the API puts it, so the next page can be requested before this one is parsed. Empty if none.
+static string find_next_link(const string &body) {
+	size_t key = body.rfind("\"next\"");
+	if (key == string::npos)
+		return "";
+	size_t pos = body.find_first_not_of(" \t\r\n", key + 6);
+	if (pos == string::npos || body[pos] != ':')
+		return "";
+	pos = body.find_first_not_of(" \t\r\n", pos + 1);
+	if (pos == string::npos || body[pos] != '"')
+		return "";
+	string link;
+	for (pos++; pos < body.size() && body[pos] != '"'; pos++) {
+		if (body[pos] == '\\' && pos + 1 < body.size())
+			pos++;
+		link += body[pos];
+	}
+	return pos < body.size() ? link : "";
+}
 
-	//unique_ptr<std::string> 
-	unique_ptr<json> jsonData = submit_curl_request(url);
+//PageWalk: state of one fetch_pages() run, shared by its page callbacks on the engine's thread.
+struct PageWalk {
+	function<string(const string &body)> consume;
+	function<void(exception_ptr)> finished;
+	string expected;       //the page whose response is used next; others were speculative
+	size_t pages = 0;
+	bool done = false;
+};
+
+static void request_page(RequestEngine &engine, shared_ptr<PageWalk> walk, const string &url) {
+	RequestEngine *pages = &engine;
+	engine.submit(HttpRequest{ HttpMethod::GET, url, "" }, [pages, walk, url](HttpResponse &response) {
+		if (walk->done || url != walk->expected)
+			return;
+		try {
+			if (response.result != CURLE_OK)
+				throw RobinhoodException("fetch_pages(): request to " + url + " failed. Error Msg: " + string(curl_easy_strerror(response.result)));
+			if ((response.httpCode != 200) and (response.httpCode != 201))
+				throw RobinhoodException("fetch_pages(): Couldn't GET from " + url + "\nError Msg:" + response.body + "\nhttpCode: " + to_string(response.httpCode));
+			if (++walk->pages > maxPages)
+				throw RobinhoodException("fetch_pages(): More than " + to_string(maxPages) + " pages from " + url);
+
+			//Prefetch: the next page downloads while this one is parsed.
+			string guess = find_next_link(response.body);
+			if (!guess.empty()) {
+				walk->expected = guess;
+				request_page(*pages, walk, guess);
+			}
+			string next;
+			try {
+				next = walk->consume(response.body);
+			}
+			catch (const json::exception &e) {
+				throw RobinhoodException("fetch_pages(): Could not parse HTTP data as JSON from " + url + ". Error message: " + string(e.what()));
+			}
+			if (next.empty()) {
+				walk->done = true;
+				walk->finished(nullptr);
+			}
+			else if (next != guess) {
+				walk->expected = next;
+				request_page(*pages, walk, next);
+			}
+		}
+		catch (...) {
+			walk->done = true;
+			walk->finished(current_exception());
+		}
+	});
+}
 
-	positions_nonzeroJsonData = (*jsonData)["results"];
-	return positions_nonzeroJsonData;
+/* fetch_pages(): GET url & every page linked from it through "next" on the request engine.
+   consume runs on the engine's thread, one page at a time in order; finished runs once, with
+   the error if a page failed.
+*/
+void RobinhoodTrader::fetch_pages(const string &url, PageConsumer consume, function<void(exception_ptr)> finished) {
+	auto walk = make_shared<PageWalk>();
+	walk->consume = std::move(consume);
+	walk->finished = std::move(finished);
+	walk->expected = url;
+	request_page(*engine, walk, url);
 }
 
-//Fetch account information
-json RobinhoodTrader::get_account() {
+//fetch_all_pages(): fetch_pages() that blocks until the last page was consumed.
+void RobinhoodTrader::fetch_all_pages(const string &url, PageConsumer consume) {
+	auto done = make_shared<promise<void>>();
+	future<void> finished = done->get_future();
+	fetch_pages(url, std::move(consume), [done](exception_ptr error) {
+		if (error)
+			done->set_exception(error);
+		else
+			done->set_value();
+	});
+	finished.get();
+}
 
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	//Accept-Encoding and automatic decompressing data.
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+//fetch_results_async(): The "results" of every page, merged into one array.
+future<json> RobinhoodTrader::fetch_results_async(const string &url) {
+	auto results = make_shared<json>(json::array());
+	auto done = make_shared<promise<json>>();
+	future<json> merged = done->get_future();
+	fetch_pages(url, [results](const string &body) {
+		json page = json::parse(body);
+		for (json &record : page["results"])
+			results->push_back(std::move(record));
+		auto next = page.find("next");
+		return next != page.end() && next->is_string() ? next->get<string>() : string();
+	}, [results, done](exception_ptr error) {
+		if (error)
+			done->set_exception(error);
+		else
+			done->set_value(std::move(*results));
+	});
+	return merged;
+}
+
+//fetch_records(): Typed records of every page, decoded with the streaming parser.
+template <typename Record>
+vector<Record> RobinhoodTrader::fetch_records(const string &url, typename RecordCollector<Record>::Assign assign, const Record &blank) {
+	auto collector = make_shared<RecordCollector<Record>>(assign, blank, true);
+	fetch_all_pages(url, [collector](const string &body) {
+		collector->next.clear();
+		JsonStreamParser parser(*collector);
+		parser.feed(body.data(), body.size());
+		parser.finish();
+		return collector->next;
+	});
+	return std::move(collector->records);
+}
 
-	//unique_ptr<std::string> 
+//Fetch account information
+json RobinhoodTrader::get_account() {
+	if (paper)
+		return account_json(paper->account());
 	unique_ptr<json> jsonData = submit_curl_request(accounts_url);
 	return (*jsonData)["results"][0];
 }
 
+//get_quote(): Get stock quote as a typed record
+Quote RobinhoodTrader::get_quote(const string &stock) {
+	if (replay) {
+		Quote quote = replay->get_quote(upper_symbol(stock));
+		observe_quote(quote);
+		return quote;
+	}
+	RecordCollector<Quote> collector(assign_quote_field, Quote(), false);
+	submit_curl_request(quotes_url + stock + "/", collector);
+	if (collector.records.empty())
+		throw RobinhoodException("get_quote(): No quote returned for " + stock);
+	instruments->insert(collector.records[0].symbol, collector.records[0].instrument);
+	observe_quote(collector.records[0]);
+	return collector.records[0];
+}
+
+//get_quotes(): Get quotes for many stocks as typed records, in the order returned by the API
+vector<Quote> RobinhoodTrader::get_quotes(const vector<string> &stocks) {
+	if (replay) {
+		vector<Quote> quotes;
+		for (const string &stock : stocks) {
+			Quote quote;
+			if (replay->quote(SymbolTable::instance().find(upper_symbol(stock)), quote)) {
+				observe_quote(quote);
+				quotes.push_back(quote);
+			}
+		}
+		return quotes;
+	}
+
+	vector<future<vector<Quote>>> chunks;
+	for (size_t begin = 0; begin < stocks.size(); begin += maxQuoteBatchSize) {
+		size_t end = std::min(begin + maxQuoteBatchSize, stocks.size());
+
+		string url = quotes_url + "?symbols=";
+		for (size_t i = begin; i < end; i++) {
+			if (i != begin)
+				url += ",";
+			url += stocks[i];
+		}
+
+		auto promise = make_shared<std::promise<vector<Quote>>>();
+		chunks.push_back(promise->get_future());
+		engine->submit(HttpRequest{ HttpMethod::GET, url, "" }, [promise, url](HttpResponse &response) {
+			try {
+				if (response.result != CURLE_OK)
+					throw RobinhoodException("get_quotes(): request to " + url + " failed. Error Msg: " + string(curl_easy_strerror(response.result)));
+				if ((response.httpCode != 200) and (response.httpCode != 201))
+					throw RobinhoodException("get_quotes(): Couldn't GET from " + url + "\nError Msg:" + response.body + "\nhttpCode: " + to_string(response.httpCode));
+
+				RecordCollector<Quote> collector(assign_quote_field, Quote(), true);
+				JsonStreamParser parser(collector);
+				parser.feed(response.body.data(), response.body.size());
+				parser.finish();
+				promise->set_value(std::move(collector.records));
+			}
+			catch (...) {
+				promise->set_exception(current_exception());
+			}
+		});
+	}
+
+	vector<Quote> quotes;
+	quotes.reserve(stocks.size());
+	for (auto &chunk : chunks) {
+		vector<Quote> records = chunk.get();
+		for (auto &quote : records) {
+			instruments->insert(quote.symbol, quote.instrument);
+			cached_quotes.put(quote);
+			observe_quote(quote);
+		}
+		quotes.insert(quotes.end(), records.begin(), records.end());
+	}
+	return quotes;
+}
+
+//get_positions(): Get all (or only open) positions as typed records
+vector<Position> RobinhoodTrader::get_positions(bool nonzero) {
+	if (paper) {
+		vector<Position> positions = paper->positions(nonzero);
+		for (Position &position : positions)
+			resolve_instrument(position);
+		return positions;
+	}
+	return fetch_records(nonzero ? positions_url + "?nonzero=true" : positions_url, assign_position_field, Position());
+}
+
+//get_account_info(): Fetch account information as a typed record
+Account RobinhoodTrader::get_account_info() {
+	if (paper)
+		return paper->account();
+	RecordCollector<Account> collector(assign_account_field, Account(), true);
+	submit_curl_request(accounts_url, collector);
+	if (collector.records.empty())
+		throw RobinhoodException("get_account_info(): No account returned");
+	return collector.records[0];
+}
+
+//get_order_list(): Get the orders (of symbol, updated since updated_since) as typed records, every page
+vector<Order> RobinhoodTrader::get_order_list(const string &symbol, int64_t updated_since) {
+	if (paper) {
+		vector<Order> orders;
+		for (Order &order : paper->orders(symbol == "" ? 0 : SymbolTable::instance().intern(upper_symbol(symbol)))) {
+			if (order.updated_at < updated_since)
+				continue;
+			resolve_instrument(order);
+			orders.push_back(order);
+		}
+		return orders;
+	}
+	Order blank = Order();
+	blank.state = UNKNOWN_STATE;
+	return fetch_records(orders_query(symbol, updated_since), assign_order_field, blank);
+}
+
+vector<Order> RobinhoodTrader::sync_orders() {
+	lock_guard<mutex> lock(sync_mutex);
+	return poll_orders();
+}
+
+/* poll_orders(): Orders changed since the last sync; moves the watermark to the newest updated_at seen.
+   Working orders get their symbol even if it isn't cached, so they can be found by symbol.  Caller
+   holds sync_mutex.
+*/
+vector<Order> RobinhoodTrader::poll_orders() {
+	vector<Order> changed = get_order_list("", orders_synced_until);
+	for (Order &order : changed)
+		if (!order.symbol)
+			order.symbol = OrderManager::working(order.state) ? symbol_of(order.instrument) : instruments->find_symbol(order.instrument);
+	for (const Order &order : changed)
+		if (order.updated_at > orders_synced_until)
+			orders_synced_until = order.updated_at;
+	tracked_orders.apply(changed);
+	//Forget finished orders after a while, so a long session doesn't accumulate its whole order history.
+	tracked_orders.prune(orders_synced_until - finishedOrderRetention);
+	return changed;
+}
+
+/* reconcile_positions(): Poll our orders so their fills reach the ledger, then hand it the broker's
+   open positions.  sync_mutex is held throughout, so no poll can count a fill the positions
+   already hold before the ledger adopts them.
+*/
+size_t RobinhoodTrader::reconcile_positions() {
+	lock_guard<mutex> lock(sync_mutex);
+	poll_orders();
+	vector<Position> open = get_positions(true);
+	for (Position &position : open)
+		if (!position.symbol)
+			position.symbol = symbol_of(position.instrument);
+	return ledger->reconcile(open);
+}
+
+void RobinhoodTrader::reset_order_sync(int64_t since) {
+	lock_guard<mutex> lock(sync_mutex);
+	orders_synced_until = since;
+}
+
+//seed_order_sync(): Unless a sync already ran, start syncing at login time instead of at the beginning of the order history.
+void RobinhoodTrader::seed_order_sync() {
+	lock_guard<mutex> lock(sync_mutex);
+	if (orders_synced_until == 0)
+		orders_synced_until = now_micros() - orderSyncSkew;
+}
+
+//orders_query(): The orders URL with the server side filters for symbol's instrument & update time.
+string RobinhoodTrader::orders_query(const string &symbol, int64_t updated_since) {
+	string url = orders_url;
+	char separator = '?';
+	if (symbol != "") {
+		char *instrument = curl_easy_escape(curl, get_instrument_url(symbol).c_str(), 0);
+		url += separator + string("instrument=") + instrument;
+		curl_free(instrument);
+		separator = '&';
+	}
+	if (updated_since) {
+		char *since = curl_easy_escape(curl, format_timestamp(updated_since).c_str(), 0);
+		url += separator + string("updated_at%5Bgte%5D=") + since;
+		curl_free(since);
+	}
+	return url;
+}
+
+//quote_data_async(): Get stock quote data without blocking
+future<json> RobinhoodTrader::quote_data_async(const string &stock) {
+	if (replay) {
+		promise<json> ready;
+		try {
+			ready.set_value(quote_data(stock));
+		}
+		catch (...) {
+			ready.set_exception(current_exception());
+		}
+		return ready.get_future();
+	}
+	return engine->submit(HttpRequest{ HttpMethod::GET, quotes_url + stock + "/", "" });
+}
+
+//positions_async(): Get all the positions without blocking
+future<json> RobinhoodTrader::positions_async() {
+	if (paper)
+		return ready(paper_positions(false));
+	return fetch_results_async(positions_url);
+}
+
+//positions_nonzero_async(): Get open positions without blocking
+future<json> RobinhoodTrader::positions_nonzero_async() {
+	if (paper)
+		return ready(paper_positions(true));
+	return fetch_results_async(positions_url + "?nonzero=true");
+}
+
+//get_account_async(): Fetch account information without blocking
+future<json> RobinhoodTrader::get_account_async() {
+	if (paper)
+		return ready(account_json(paper->account()));
+	return engine->submit(HttpRequest{ HttpMethod::GET, accounts_url, "" },
+		[](json &jsonData) { return std::move(jsonData["results"][0]); });
+}
+
+//account(): The cached account record, fetched on first use.
+Account RobinhoodTrader::account() {
+	//Paper balances change with every fill, nothing to cache.
+	if (paper)
+		return paper->account();
+	{
+		lock_guard<mutex> lock(account_mutex);
+		if (account_cached)
+			return cached_account;
+	}
+	return refresh_account();
+}
+
+//account_url(): URL of the cached account, as expected in order post data.
+string RobinhoodTrader::account_url() {
+	return accounts_url + account().account_number.data + "/";
+}
+
+//refresh_account(): Re-fetch the account & replace the cached record.
+Account RobinhoodTrader::refresh_account() {
+	Account fresh = get_account_info();
+	lock_guard<mutex> lock(account_mutex);
+	cached_account = fresh;
+	account_cached = true;
+	return fresh;
+}
+
+//invalidate_account(): Drop the cached record; the next account() call fetches it again.
+void RobinhoodTrader::invalidate_account() {
+	lock_guard<mutex> lock(account_mutex);
+	account_cached = false;
+}
+
 //**************Orders ***************************************
 
 //get_orders(): Get all the orders for a given stock
 json RobinhoodTrader::get_orders(const string& symbol) {
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+	if (paper) {
+		json results = json::array();
+		for (Order &order : paper->orders(symbol == "" ? 0 : SymbolTable::instance().intern(upper_symbol(symbol)))) {
+			resolve_instrument(order);
+			results.push_back(order_json(order));
+		}
+		return json{ { "previous", nullptr }, { "next", nullptr }, { "results", std::move(results) } };
+	}
+	//Filter by instrument on the server, then walk every page
+	json results = fetch_results_async(orders_query(symbol, 0)).get();
+	return json{ { "previous", nullptr }, { "next", nullptr }, { "results", std::move(results) } };
+}
 
-	//Get instrument URL
-	json current_quote = quote_data(symbol);
-	string _instrument_URL = current_quote["instrument"].get<string>();
+/* get_instrument_url(): Instrument URL of a stock, from the instrument cache when possible.  Paper
+   orders go by symbol & need none.  Replayed quotes carry no instrument & reading one would step
+   the replay, so replay asks the instruments endpoint instead.
+*/
+string RobinhoodTrader::get_instrument_url(const string &symbol) {
+	string _symbol = upper_symbol(symbol);
+
+	RobinhoodId instrument;
+	if (!instruments->find(_symbol, instrument)) {
+		if (paper)
+			return "";
+		instrument = replay ? instrument_of(_symbol) : get_quote(_symbol).instrument;     //caches the instrument
+	}
+	return instrument_url(instrument);
+}
 
-	//unique_ptr<std::string> 
-	unique_ptr<json> jsonData = submit_curl_request(orders_url);
-	return *jsonData;
+
+//make_order_template(): Pre-encode the constant part of an order using the cached account & instrument.
+OrderTemplate RobinhoodTrader::make_order_template(
+	const string &symbol,
+	Side side,
+	OrderType order_type,
+	TimeInForce time_in_force,
+	Trigger trigger,
+	const string &instrument_URL
+	) {
+	if (instrument_URL == "" && symbol == "")
+		throw RobinhoodException("make_order_template(): Neither instrument_URL nor symbol were passed");
+
+	return OrderTemplate(account_url(),
+		instrument_URL == "" ? get_instrument_url(symbol) : instrument_URL,
+		symbol, side, order_type, time_in_force, trigger);
+}
+
+//submit_order(): Post the body last built into order.
+json RobinhoodTrader::submit_order(const OrderTemplate &order) {
+	if (paper) {
+		Order ack = paper_submit(order);
+		track_order(ack, ack.symbol);
+		return order_json(ack);
+	}
+
+	unique_ptr<json> jsonData;
+	{
+		//Post straight from the template's buffer, no copy of the body.
+		lock_guard<mutex> lock(curl_mutex);
+		prepare_handle(HttpMethod::POST, orders_url, order.data(), order.size(), nullptr);
+		jsonData = perform_request(orders_url);
+	}
+
+	track_order(parse_order(*jsonData), order.symbol().empty() ? 0 : SymbolTable::instance().intern(upper_symbol(order.symbol())));
+	return std::move(*jsonData);
+}
+
+//submit_order(): Fill in quantity & prices, then post the order.
+json RobinhoodTrader::submit_order(OrderTemplate &order, int quantity, Price price, Price stop_price) {
+	order.build(quantity, price, stop_price);
+	return submit_order(order);
+}
+
+//submit_order_async(): Fill in quantity & prices, then queue the order without waiting for the response.
+future<Order> RobinhoodTrader::submit_order_async(OrderTemplate &order, int quantity, Price price, Price stop_price) {
+	auto promise = make_shared<std::promise<Order>>();
+	auto result = promise->get_future();
+
+	submit_order_async(order, quantity, price, stop_price, [promise](const Order &ack, exception_ptr error) {
+		if (error)
+			promise->set_exception(error);
+		else
+			promise->set_value(ack);
+	});
+	return result;
 }
 
+void RobinhoodTrader::submit_order_async(OrderTemplate &order, int quantity, Price price, Price stop_price, OrderGateway::Callback callback) {
+	order.build(quantity, price, stop_price);
+	if (paper) {
+		Order ack;
+		try {
+			ack = paper_submit(order);
+		}
+		catch (...) {
+			callback(Order(), current_exception());
+			return;
+		}
+		track_order(ack, ack.symbol);
+		callback(ack, nullptr);
+		return;
+	}
+	SymbolId symbol = order.symbol().empty() ? 0 : SymbolTable::instance().intern(upper_symbol(order.symbol()));
+	gateway->submit(order, [this, callback, symbol](const Order &ack, exception_ptr error) {
+		if (!error)
+			track_order(ack, symbol);
+		callback(ack, error);
+	});
+}
 
 /* submit_buy_order(): Place buy order.  This is normally not called directly. Most programs should use
 	one of the following instead : 
@@ -283,49 +1182,20 @@ int RobinhoodTrader::submit_buy_order(
 	stop_price: The price at which the order becomes a market or limit order
 	*/
 
-	string postFields;
-	string _symbol(symbol);
-	json current_quote;
-	float current_ask_price;
+	string _instrument_URL(instrument_URL);
 
 	// Check the parameters.
-	if (instrument_URL == "") {
-		if (_symbol == "") 
+	if (_instrument_URL == "") {
+		if (symbol == "")
 			throw RobinhoodException("submit_buy_order(): Neither instrument_URL nor symbol were passed to submit_buy_order()");
-		else 
-		{
-			cout << "Instrument_URL not passed to submit_buy_order" << endl;
-			current_quote = quote_data(symbol);
-
-			string _instrument_URL = current_quote["instrument"].get<string>();
-			postFields = "instrument=" + _instrument_URL;
-
-			std::transform(_symbol.begin(), _symbol.end(), _symbol.begin(), ::toupper);
-			postFields = postFields + "&symbol=" + _symbol;
-		
-			//Get current ask price
-			current_ask_price = stof(current_quote["ask_price"].get<string>());
-			if (current_ask_price == 0)
-				current_ask_price = stof(current_quote["last_trade_price"].get<string>());
-
-		}
+		RH_LOG(LOG_DEBUG, "Instrument_URL not passed to submit_buy_order");
+		_instrument_URL = get_instrument_url(symbol);
 	}
 	else {
-		postFields = "instrument=" + instrument_URL;
-		if (_symbol == "")
-			cout << "Symbol not passed to submit_buy_order" << endl;
-		else {
-			std::transform(_symbol.begin(), _symbol.end(), _symbol.begin(), ::toupper);
-			postFields = postFields + "&symbol=" + _symbol;
-		}
+		if (symbol == "")
+			RH_LOG(LOG_DEBUG, "Symbol not passed to submit_buy_order");
 	}
 
-	if (order_type == OrderType::MARKET)
-		//std::transform(_order_type.begin(), _order_type.end(), _order_type.begin(), ::tolower);
-		postFields = postFields + "&type=market";
-	else
-		postFields = postFields + "&type=limit";
-
 	if (order_type == OrderType::LIMIT)
 		if (price <= 0)
 			throw RobinhoodException("submit_buy_order(): limit price must be greater than 0");
@@ -334,21 +1204,6 @@ int RobinhoodTrader::submit_buy_order(
 		if (order_type == OrderType::MARKET)
 			throw RobinhoodException("submit_buy_order(): Market order has limit price");
 
-	if (side == Side::BUY)
-		postFields = postFields + "&side=buy";
-	else 
-		postFields = postFields + "&side=sell";
-
-	if (time_in_force == TimeInForce::GTC)
-		postFields = postFields + "&time_in_force=gtc";
-	else
-		postFields = postFields + "&time_in_force=gfd";
-
-	if (trigger == Trigger::STOP)
-		postFields = postFields + "&trigger=stop";
-	else
-		postFields = postFields + "&trigger=immediate";
-
 	if (trigger == Trigger::STOP) {
 		if (stop_price <= 0)
 			throw RobinhoodException("submit_buy_order(): Stop_price must be greater than 0");
@@ -357,29 +1212,19 @@ int RobinhoodTrader::submit_buy_order(
 	if (stop_price > 0) {
 		if (trigger != Trigger::STOP)
 			throw RobinhoodException("submit_buy_order(): Stop price set for non-stop order");
-		postFields = postFields + "&stop_price=" + to_string(stop_price);
-	}
-
-	if (price > 0) {
-		price = float(price);
-		postFields = postFields + "&price=" + to_string(price);
 	}
 
 	if (quantity <= 0)
 		throw RobinhoodException("submit_buy_order(): Quantity must be positive number");
-	else {
-		quantity = int(quantity);
-		postFields = postFields + "&quantity=" + to_string(quantity);
-	}
 
-	json account = get_account();
-	postFields = postFields + "&account=" + account["url"].get<string>();
-	cout << "submit_buy_order: postFields:" << postFields << endl;
-	
-	//Set post data & set request type to POST
-	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postFields.c_str());
-	auto jsonData = submit_curl_request(orders_url);
-	cout << "\n submit_buy_order() response: " << (*jsonData).dump() << endl;
+	OrderTemplate order(account_url(), _instrument_URL, symbol, side, order_type, time_in_force, trigger);
+	order.build(quantity, Price::from_double(price), Price::from_double(stop_price));
+	RH_LOG(LOG_DEBUG, "submit_buy_order: postFields:{}", order.data());
+
+	json jsonData = submit_order(order);
+	RH_LOG(LOG_INFO, "submit_buy_order(): {} {} {} -> order {} {}", symbol, quantity, Price::from_double(price),
+		jsonData.value("id", ""), jsonData.value("state", ""));
+	RH_LOG(LOG_DEBUG, "submit_buy_order response: {}", jsonData.dump());
 
 	return 0;
 } //submit_buy_order
@@ -532,50 +1377,20 @@ int RobinhoodTrader::submit_sell_order (
 	side: BUY or sell
 	*/
 
-	string postFields;
-	string _symbol(symbol);
-	json current_quote;
-	float current_bid_price;
-
-
-	// Check parameters.
-	if (instrument_URL == "") {
-		if (_symbol == "") {
-			throw RobinhoodException("submit_sell_order(): Neither instrument_URL nor symbol were passed"); 
-			//cerr << "Neither instrument_URL nor symbol were passed to submit_sell_order" << endl;
-		}
-		else
-		{
-			cout << "Instrument_URL not passed to submit_buy_order" << endl;
-
-			current_quote = quote_data(symbol);
-
-			current_bid_price = stof(current_quote["bid_price"].get<string>());
-			if (current_bid_price == 0)
-				current_bid_price = stof(current_quote["last_trade_price"].get<string>());
-
-			string _instrument_URL = current_quote["instrument"].get<string>();
-			postFields = "instrument=" + _instrument_URL;
+	string _instrument_URL(instrument_URL);
 
-			std::transform(_symbol.begin(), _symbol.end(), _symbol.begin(), ::toupper);
-			postFields = postFields + "&symbol=" + _symbol;
-		}
+	// Check the parameters.
+	if (_instrument_URL == "") {
+		if (symbol == "")
+			throw RobinhoodException("submit_sell_order(): Neither instrument_URL nor symbol were passed");
+		RH_LOG(LOG_DEBUG, "Instrument_URL not passed to submit_sell_order");
+		_instrument_URL = get_instrument_url(symbol);
 	}
 	else {
-		postFields = "instrument=" + instrument_URL;
-		if (_symbol == "")
+		if (symbol == "")
 			throw RobinhoodException("submit_sell_order(): No stock symbol passed");
-		else {
-			std::transform(_symbol.begin(), _symbol.end(), _symbol.begin(), ::toupper);
-			postFields = postFields + "&symbol=" + _symbol;
-		}
 	}
 
-	if (order_type == OrderType::MARKET)
-		postFields = postFields + "&type=market";
-	else
-			postFields = postFields + "&type=limit";
-
 	if (order_type == OrderType::LIMIT)
 		if (price <= 0)
 			throw RobinhoodException("submit_sell_order(): Price must be greater than 0 for limit order");
@@ -584,21 +1399,6 @@ int RobinhoodTrader::submit_sell_order (
 		if (order_type == OrderType::MARKET)
 			throw RobinhoodException("submit_sell_order(): Market order has limit price");
 
-	if (side == Side::BUY)
-		postFields = postFields + "&side=buy";
-	else
-		postFields = postFields + "&side=sell";
-
-	if (time_in_force == TimeInForce::GTC)
-		postFields = postFields + "&time_in_force=gtc";
-	else 
-		postFields = postFields + "&time_in_force=gfd";
-
-	if (trigger == Trigger::STOP)
-		postFields = postFields + "&trigger=stop";
-	else 
-		postFields = postFields + "&trigger=immediate";
-
 	if (trigger == Trigger::STOP) {
 		if (stop_price <= 0)
 			throw RobinhoodException("submit_sell_order(): Stop_price must be greater than 0");
@@ -607,35 +1407,21 @@ int RobinhoodTrader::submit_sell_order (
 	if (stop_price > 0) {
 		if (trigger != Trigger::STOP)
 			throw RobinhoodException("submit_sell_order(): Stop price set for non-stop order");
-		postFields = postFields + "&stop_price=" + to_string(stop_price);
-	}
-
-	if (price > 0) {
-		//error case: to_string(price) gives 26.780001 when price is 26.78 
-		stringstream ss_price; 
-		ss_price << price;
-		postFields = postFields + "&price=" + ss_price.str() ;
 	}
 
 	if (quantity <= 0)
 		throw RobinhoodException("submit_sell_order(): Quantity must be greater than 0");
-	else {
-		quantity = int(quantity);
-		postFields = postFields + "&quantity=" + to_string(quantity);
-	}
-
-	json account = get_account();
-	postFields = postFields + "&account=" + account["url"].get<string>();
 
-	cout << "submit_sell_order: postFields:" << postFields << endl;
+	OrderTemplate order(account_url(), _instrument_URL, symbol, side, order_type, time_in_force, trigger);
+	order.build(quantity, Price::from_double(price), Price::from_double(stop_price));
+	RH_LOG(LOG_DEBUG, "submit_sell_order: postFields:{}", order.data());
 
-	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postFields.c_str());
-
-	auto jsonData = submit_curl_request(orders_url);
-	cout << "\n submit_sell_order response: " << (*jsonData).dump() << endl;
+	json jsonData = submit_order(order);
+	RH_LOG(LOG_INFO, "submit_sell_order(): {} {} {} -> order {} {}", symbol, quantity, Price::from_double(price),
+		jsonData.value("id", ""), jsonData.value("state", ""));
+	RH_LOG(LOG_DEBUG, "submit_sell_order response: {}", jsonData.dump());
 
 	return 0;
-
 } //submit_sell_order
 
 int RobinhoodTrader::place_market_sell_order(
@@ -725,26 +1511,143 @@ int RobinhoodTrader::place_stop_loss_sell_order(
 }
 
 
+//cancel_order(): Cancel an order with a single POST to its cancel endpoint.
 int RobinhoodTrader::cancel_order(const string &orderId) {
-	string url = orders_url + orderId +"/";
+	if (paper) {
+		if (!paper->cancel(orderId))
+			throw RobinhoodException("cancel_order(): Order " + orderId + " is not working");
+		return 0;
+	}
 
-	//Set request type to GET
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+	//The cancel link of a tracked order, as its ack or last poll gave it.
+	string cancelUrl = orders_url + orderId + "/cancel/";
+	Order tracked;
+	if (tracked_orders.find(orderId, tracked) && !tracked.cancel_url.empty())
+		cancelUrl = tracked.cancel_url.str();
 
-	unique_ptr<json> orderData = submit_curl_request(url);
-	cout << "cancel_order(): OrderData: " << *orderData << endl;
+	//POST with an empty body
+	unique_ptr<json> response = submit_curl_request(HttpRequest{ HttpMethod::POST, cancelUrl, "" });
+	RH_LOG(LOG_INFO, "cancel_order(): Cancelled {}", orderId);
+	RH_LOG(LOG_DEBUG, "cancel_order(): Response: {}", response->dump());
+	return 0;
+}
 
-	string cancelUrl;
-	if ((*orderData)["cancel"].is_null())
-		throw RobinhoodException("cancel_order(): Failed to cancel order id: " + orderId );
-	else { 
-		cancelUrl = (*orderData)["cancel"].get<string>();
-		//Set request type to POST
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+//cancel_all_orders(): Cancel every cancellable order (of symbol, if given) concurrently. Returns the number cancelled.
+int RobinhoodTrader::cancel_all_orders(const string &symbol) {
+	if (paper)
+		return static_cast<int>(paper->cancel_all(symbol == "" ? 0 : SymbolTable::instance().intern(upper_symbol(symbol))));
+
+	//One incremental poll brings the tracked orders up to date; no walk of the order history.
+	sync_orders();
+	vector<pair<string, future<json>>> cancels;
+	for (const Order &order : tracked_orders.open_orders(symbol == "" ? 0 : SymbolTable::instance().intern(upper_symbol(symbol)))) {
+		if (order.cancel_url.empty())
+			continue;
+		cancels.emplace_back(order.id.str(), engine->submit(HttpRequest{ HttpMethod::POST, order.cancel_url.str(), "" }));
+	}
 
-		unique_ptr<json> orderData2 = submit_curl_request(cancelUrl);
-		cout << "cancel_order(): Response: " << *orderData2 << endl;
+	int cancelled = 0;
+	string failures;
+	for (auto &cancel : cancels) {
+		try {
+			cancel.second.get();
+			cancelled++;
+		}
+		catch (const exception &e) {
+			failures += "\n" + cancel.first + ": " + e.what();
+		}
 	}
-	return 0;
+	if (!failures.empty())
+		throw RobinhoodException("cancel_all_orders(): Cancelled " + to_string(cancelled) + " of " + to_string(cancels.size()) +
+								" orders. Failed:" + failures);
+	return cancelled;
+}
+
+//track_order(): Hand a submitted order to the order manager, with the symbol it was placed for.
+void RobinhoodTrader::track_order(Order ack, SymbolId symbol) {
+	if (!ack.symbol)
+		ack.symbol = symbol ? symbol : instruments->find_symbol(ack.instrument);
+	tracked_orders.record(ack);
+}
+
+//observe_quote(): Show a quote to the paper exchange so working orders can match.  A replayed
+//record is shown once, however often it is read.
+void RobinhoodTrader::observe_quote(const Quote &quote) {
+	if (replay) {
+		lock_guard<mutex> lock(observed_mutex);
+		Quote &seen = replay_observed[quote.symbol];
+		if (memcmp(&seen, &quote, sizeof(Quote)) == 0)
+			return;
+		seen = quote;
+	}
+	if (paper)
+		paper->on_quote(quote);
+	ledger->on_quote(quote);
+}
+
+//symbol_of(): Symbol of an instrument id, looked up on the instruments endpoint if it isn't cached.
+SymbolId RobinhoodTrader::symbol_of(const RobinhoodId &instrument) {
+	SymbolId symbol = instruments->find_symbol(instrument);
+	if (symbol || instrument.empty())
+		return symbol;
+
+	unique_ptr<json> jsonData = submit_curl_request(instrument_url(instrument));
+	auto found = jsonData->find("symbol");
+	if (found == jsonData->end() || !found->is_string())
+		throw RobinhoodException("symbol_of(): No symbol for instrument " + instrument.str() + ". Json data received: " + jsonData->dump());
+	symbol = SymbolTable::instance().intern(upper_symbol(found->get<string>()));
+	instruments->insert(symbol, instrument);
+	return symbol;
+}
+
+//instrument_of(): Instrument of a symbol (upper case), looked up on the instruments endpoint if it isn't cached.
+RobinhoodId RobinhoodTrader::instrument_of(const string &symbol) {
+	RobinhoodId instrument;
+	if (instruments->find(symbol, instrument))
+		return instrument;
+
+	unique_ptr<json> jsonData = submit_curl_request(instruments_url + "?symbol=" + symbol);
+	auto results = jsonData->find("results");
+	if (results == jsonData->end() || !results->is_array() || results->empty() || !(*results)[0]["url"].is_string())
+		throw RobinhoodException("instrument_of(): No instrument for " + symbol + ". Json data received: " + jsonData->dump());
+	const string &url = (*results)[0]["url"].get_ref<const string &>();
+	parse_instrument_id(url.data(), url.size(), instrument);
+	instruments->insert(SymbolTable::instance().intern(symbol), instrument);
+	return instrument;
+}
+
+//resolve_instrument(): Paper records only know their symbol; add the instrument if it is cached.
+template <typename Record>
+void RobinhoodTrader::resolve_instrument(Record &record) {
+	if (record.instrument.empty() && record.symbol != 0)
+		instruments->find(SymbolTable::instance().name(record.symbol), record.instrument);
+}
+
+json RobinhoodTrader::paper_positions(bool nonzero) {
+	json results = json::array();
+	for (Position &position : get_positions(nonzero))
+		results.push_back(position_json(position));
+	return results;
+}
+
+//paper_submit(): Route an order to the paper exchange.
+Order RobinhoodTrader::paper_submit(const OrderTemplate &order) {
+	if (order.symbol().empty())
+		throw RobinhoodException("submit_order(): Paper orders need a symbol");
+	SymbolId symbol = SymbolTable::instance().intern(order.symbol());
+
+	//Market orders need a price to fill at & buys a price to hold cash at.  A replay's current
+	//record is used as is; stepping it would move the market under the caller.
+	if (!paper->has_quote(symbol)) {
+		Quote quote;
+		if (replay && replay->current(symbol, quote))
+			observe_quote(quote);
+		else
+			get_quote(order.symbol());
+	}
+
+	Order ack = paper->submit(symbol, order.side(), order.order_type(), order.trigger(), order.time_in_force(),
+							order.quantity(), order.price(), order.stop_price());
+	resolve_instrument(ack);
+	return ack;
 }
@@ -1,24 +1,136 @@
 #pragma once
 #include <curl/curl.h>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <functional>
+#include <mutex>
 #include <nlohmann/json.hpp>    
+#include "requestengine.h"
+#include "records.h"
+#include "jsonstream.h"
+#include "instrumentcache.h"
+#include "quotecache.h"
+#include "quotepoller.h"
+#include "quotereplay.h"
+#include "paperexchange.h"
+#include "ordertemplate.h"
+#include "ordergateway.h"
+#include "transport.h"
+#include "latencystats.h"
+#include "tokenmanager.h"
+#include "ordermanager.h"
+#include "positionledger.h"
 
 using json = nlohmann::json;
 
-enum Trigger {IMMEDIATE, STOP};
-enum OrderType {MARKET, LIMIT};
-enum TimeInForce {GFD, GTC };
-enum Side {BUY, SELL };
-
 class RobinhoodTrader {
 private:
+	TransportProfile profile;
+	std::shared_ptr<SharedTransport> shared;   //DNS & TLS session caches of all our handles
 	CURL* curl;
-	struct curl_slist *headers;
+	std::mutex curl_mutex;                     //serialises use of the blocking handle
+	HttpMethod handle_method;                  //method the handle is configured for
+	curl_slist *handle_headers;                //header list set on the handle
+	HeaderList handle_list;                    //keeps handle_headers alive if it is the session's list
+	bool handle_streaming;                     //write callback set on the handle
+	HeaderList headers;                        //session headers; replaced lists live on while requests use them
+	LatencyStats latency;                      //timings of every request, blocking & asynchronous
+	std::string auth_token;
+	std::string refresh_token;
+	mutable std::mutex token_mutex;            //guards auth_token & refresh_token; the token refresher replaces them
+	std::unique_ptr<RequestEngine> engine;
+	std::unique_ptr<OrderGateway> gateway;
+	std::unique_ptr<TokenManager> tokens;      //refreshes auth_token before it expires
+	std::shared_ptr<InstrumentCache> instruments;
+	QuoteCache cached_quotes;                  //top of book reused by ask_price() & friends
+	std::unique_ptr<QuotePoller> poller;       //background quotes, used by ask_price() & friends while running
+	std::shared_ptr<QuoteReplay> replay;       //serves every quote method when set
+	std::unordered_map<SymbolId, Quote> replay_observed;    //record of each symbol last passed to observe_quote()
+	std::mutex observed_mutex;
+	std::shared_ptr<PaperExchange> paper;      //executes orders & answers account queries when set
+	Account cached_account;
+	bool account_cached;
+	mutable std::mutex account_mutex;
+	bool follower;                             //set_follower(): no background threads of our own
+	int64_t orders_synced_until;               //newest updated_at seen by sync_orders()
+	std::mutex sync_mutex;
+	OrderManager tracked_orders;               //our submissions, advanced by sync_orders()
+	std::unique_ptr<PositionLedger> ledger;    //positions from tracked_orders' fills & our quotes
+
+	void cache_instrument(const json &quote);
+	Quote top_of_book(const std::string &stock, bool step = false);
+	void observe_quote(const Quote &quote);
+	template <typename Record> void resolve_instrument(Record &record);
+	json paper_positions(bool nonzero);
+	Order paper_submit(const OrderTemplate &order);
+	void install_headers(const std::string &token);
+	void install_session(const OAuthSession &session);
+
+	//Pagination on the request engine. A PageConsumer parses one page & returns its next link.
+	typedef std::function<std::string(const std::string &body)> PageConsumer;
+	void fetch_pages(const std::string &url, PageConsumer consume, std::function<void(std::exception_ptr)> finished);
+	void fetch_all_pages(const std::string &url, PageConsumer consume);
+	std::future<json> fetch_results_async(const std::string &url);
+	template <typename Record>
+	std::vector<Record> fetch_records(const std::string &url, typename RecordCollector<Record>::Assign assign, const Record &blank);
+	std::string orders_query(const std::string &symbol, int64_t updated_since);
+	OAuthSession refresh_session(const OAuthSession &current);
+
+	//Blocking request primitives; the caller holds curl_mutex.
+	void prepare_handle(HttpMethod method, const std::string &url, const char *body, std::size_t bodyLen, curl_slist *requestHeaders);
+	std::unique_ptr<json> perform_request(const std::string &url);
+	void perform_request(const std::string &url, JsonStreamHandler &handler);
+	void track_order(Order ack, SymbolId symbol);
+	SymbolId symbol_of(const RobinhoodId &instrument);
+	RobinhoodId instrument_of(const std::string &symbol);
+	std::vector<Order> poll_orders();
+	void seed_order_sync();
 
 public:
-	RobinhoodTrader();
+	//shared: DNS/TLS session caches to share with other traders; by default each trader has its own.
+	//instruments: instrument cache to share, e.g. across a session pool; by default each trader has its own.
+	explicit RobinhoodTrader(const TransportProfile &profile = TransportProfile(), std::shared_ptr<SharedTransport> shared = nullptr,
+							std::shared_ptr<InstrumentCache> instruments = nullptr);
+	//Replay mode: quote methods are answered from recorded ticks, nothing else changes.
+	explicit RobinhoodTrader(std::shared_ptr<QuoteReplay> replay, const TransportProfile &profile = TransportProfile());
+	//Paper trading: orders, positions & account are simulated by paper against live
+	//quotes, or against replay's when given.
+	explicit RobinhoodTrader(std::shared_ptr<PaperExchange> paper, std::shared_ptr<QuoteReplay> replay = nullptr,
+							const TransportProfile &profile = TransportProfile());
+	~RobinhoodTrader();
+	RobinhoodTrader(const RobinhoodTrader &) = delete;
+	RobinhoodTrader &operator=(const RobinhoodTrader &) = delete;
+	//warm_up(): Pre-connect so the first order pays no handshake. Returns false if a connection failed.
+	bool warm_up();
 	int login(const std::string& username, const std::string& password, const std::string& qr_code);
-	std::unique_ptr<json> submit_curl_request( const std::string &url);
+
+	//Session persistence: restore_session() reuses the session saved by an earlier run (refreshing
+	//it if it expired) & returns false if the caller has to login() instead.  persist_session()
+	//saves the session now & whenever the token manager refreshes it.
+	bool restore_session(const std::string &path, const std::string &passphrase);
+	void persist_session(const std::string &path, const std::string &passphrase);
+	//Background token refresh, running once logged in: token_manager().set_margin(...), refresh_now().
+	TokenManager &token_manager() { return *tokens; }
+
+	//Session sharing: use another login's bearer token instead of logging in again.
+	std::string get_auth_token() const;
+	void use_auth_token(const std::string &token);
+	//adopt_session(): Take over token & cached account of a logged in trader; its cached instruments
+	//are merged into ours unless both traders were constructed with the same cache.
+	void adopt_session(const RobinhoodTrader &other);
+	//set_follower(): A follower runs no token refresher, position ledger or quote poller of its own;
+	//login() & restore_session() leave them stopped.  For sessions kept current by adopt_session().
+	void set_follower(bool follower);
+	//submit_curl_request(): Run request on the blocking handle & return the parsed response. Thread safe.
+	std::unique_ptr<json> submit_curl_request(const HttpRequest &request);
+	//Streaming variant: handler decodes the response as it arrives, no DOM is built.
+	void submit_curl_request(const HttpRequest &request, JsonStreamHandler &handler);
+	//GET shorthands.
+	std::unique_ptr<json> submit_curl_request(const std::string &url);
+	void submit_curl_request(const std::string &url, JsonStreamHandler &handler);
 	static std::size_t write_callback(const char* in, std::size_t size, std::size_t num, std::string* out) {
 		const std::size_t totalBytes(size * num);
 		out->append(in, totalBytes);
@@ -26,14 +138,89 @@ public:
 	}
 
 	json quote_data(const std::string &stock);
+	//Top of book from the quote poller when it is running & fresh, else from the quote cache:
+	//one request per symbol per TTL, shared by concurrent callers.  When replaying, see QuoteReplay
+	//for which of them step the replay.
 	float ask_price(const std::string &stock);
 	float bid_price(const std::string &stock);
 	int ask_size(const std::string &stock);
 	int bid_size(const std::string &stock);
+
+	//Batch variants: one /quotes/?symbols= request per chunk of symbols, results indexed by symbol
+	//as passed (any case).
+	std::unordered_map<std::string, json> quote_data_batch(const std::vector<std::string> &stocks);
+	std::unordered_map<std::string, float> ask_price_batch(const std::vector<std::string> &stocks);
+	std::unordered_map<std::string, float> bid_price_batch(const std::vector<std::string> &stocks);
+	//Positions & orders are read page by page; each next page is requested before the current
+	//one is parsed. Results of all pages are merged.
 	json positions();
 	json positions_nonzero();
 	json get_account();
-	json get_orders(const std::string& symbol);
+	//get_orders(): Orders of symbol (filtered by instrument on the server), or all orders.
+	json get_orders(const std::string& symbol = "");
+
+	//Account record cached at login. Orders use account_url() instead of calling get_account().
+	Account account();
+	std::string account_url();
+	Account refresh_account();
+	void invalidate_account();
+
+	//Instrument URL of a stock; only the first lookup of a symbol costs a request (a quote, or the
+	//instruments endpoint when replaying). Empty when paper trading an uncached symbol.
+	std::string get_instrument_url(const std::string &symbol);
+	//Load a snapshot at startup with instrument_cache().load(path), save it with save(path).
+	InstrumentCache &instrument_cache() { return *instruments; }
+	//Freshness of ask_price()/bid_price()/ask_size()/bid_size(): quote_cache().set_ttl(...).
+	QuoteCache &quote_cache() { return cached_quotes; }
+	//Background refresh: quote_poller().subscribe("XLF"); quote_poller().start();
+	QuotePoller &quote_poller() { return *poller; }
+	//Per-endpoint timings: latency_stats().to_text(), or dump("robinhood.prom") for Prometheus.
+	LatencyStats &latency_stats() { return latency; }
+	bool replaying() const { return replay != nullptr; }
+	bool paper_trading() const { return paper != nullptr; }
+
+	//Typed variants: fixed-point records instead of JSON documents.
+	Quote get_quote(const std::string &stock);
+	std::vector<Quote> get_quotes(const std::vector<std::string> &stocks);
+	std::vector<Position> get_positions(bool nonzero = false);
+	Account get_account_info();
+	//get_order_list(): Orders of symbol (or all) updated at or after updated_since (microseconds since epoch, 0: any time).
+	std::vector<Order> get_order_list(const std::string &symbol = "", int64_t updated_since = 0);
+	//sync_orders(): Incremental get_order_list(): orders updated since the previous sync (at or
+	//after its newest updated_at, so boundary orders can repeat), since login() or restore_session()
+	//on the first call.  The changes advance order_manager().
+	std::vector<Order> sync_orders();
+	//reset_order_sync(): Make the next sync_orders() start from since (0: all orders).
+	void reset_order_sync(int64_t since = 0);
+	//Every submission & every sync_orders() result, by id & symbol: order_manager().open_orders(symbol), working_quantity(BUY).
+	//Finished orders are forgotten an hour after the newest update synced.
+	OrderManager &order_manager() { return tracked_orders; }
+	//Positions & P&L from our fills & quotes, reconciled with positions_nonzero() at login & every minute:
+	//position_ledger().exposure(), find(symbol, position).
+	PositionLedger &position_ledger() { return *ledger; }
+	//reconcile_positions(): sync_orders(), then adopt positions_nonzero() into position_ledger(). Returns the symbols corrected.
+	std::size_t reconcile_positions();
+
+	//Asynchronous variants: run concurrently on the request engine's connection pool.
+	std::future<json> quote_data_async(const std::string &stock);
+	std::future<json> positions_async();
+	std::future<json> positions_nonzero_async();
+	std::future<json> get_account_async();
+
+	//Pre-encoded orders for repeated submission on the same instrument without allocation.
+	OrderTemplate make_order_template(const std::string &symbol,
+						Side side,
+						OrderType order_type,
+						TimeInForce time_in_force,
+						Trigger trigger,
+						const std::string &instrument_URL = ""
+						);
+	json submit_order(const OrderTemplate &order);
+	json submit_order(OrderTemplate &order, int quantity, Price price = Price(), Price stop_price = Price());
+
+	//Non-blocking submission: the calling thread only builds the body & queues it.
+	std::future<Order> submit_order_async(OrderTemplate &order, int quantity, Price price = Price(), Price stop_price = Price());
+	void submit_order_async(OrderTemplate &order, int quantity, Price price, Price stop_price, OrderGateway::Callback callback);
 
 	int submit_buy_order( const std::string &symbol, 
 						Side side,
@@ -114,5 +301,9 @@ public:
 		);
 
 	int cancel_order(const std::string &orderId);
+	//cancel_all_orders(): Flatten working orders, all of them or only those of symbol.  The orders are
+	//order_manager()'s working ones after a sync_orders(); reset_order_sync(0) first to include
+	//orders last updated before login.
+	int cancel_all_orders(const std::string &symbol = "");
 
 };
\ No newline at end of file
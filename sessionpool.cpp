@@ -0,0 +1,80 @@
+/* sessionpool.cpp: pool of trader sessions sharing one login */
+
+#include <functional>
+#include <thread>
+
+#include "sessionpool.h"
+#include "exceptions.h"
+
+using namespace std;
+
+TraderSessionPool::Lease &TraderSessionPool::Lease::operator=(Lease &&other) {
+	if (this != &other) {
+		release();
+		pool = other.pool;
+		index = other.index;
+		other.pool = nullptr;
+	}
+	return *this;
+}
+
+void TraderSessionPool::Lease::release() {
+	if (pool) {
+		pool->busy[index].store(false, memory_order_release);
+		pool = nullptr;
+	}
+}
+
+TraderSessionPool::TraderSessionPool(size_t size, const TransportProfile &profile)
+	: busy(new atomic<bool>[size]) {
+	if (size == 0)
+		throw RobinhoodException("TraderSessionPool(): Pool needs at least one session");
+
+	//One DNS & TLS session cache & one instrument cache for the whole pool.
+	shared_ptr<SharedTransport> shared;
+	if (profile.share_handles)
+		shared = make_shared<SharedTransport>();
+	shared_ptr<InstrumentCache> instruments = make_shared<InstrumentCache>();
+
+	sessions.reserve(size);
+	for (size_t i = 0; i < size; i++) {
+		sessions.emplace_back(new RobinhoodTrader(profile, shared, instruments));
+		//Only the first session refreshes the token & runs the ledger; share_session() keeps the rest current.
+		if (i > 0)
+			sessions[i]->set_follower(true);
+		busy[i].store(false, memory_order_relaxed);
+	}
+}
+
+int TraderSessionPool::login(const string &username, const string &password, const string &qr_code) {
+	int result = sessions[0]->login(username, password, qr_code);
+	share_session();
+	//The first session's token manager refreshes the login for all of them.
+	sessions[0]->token_manager().set_listener([this](const OAuthSession &) { share_session(); });
+	return result;
+}
+
+void TraderSessionPool::share_session() {
+	for (size_t i = 1; i < sessions.size(); i++)
+		sessions[i]->adopt_session(*sessions[0]);
+}
+
+TraderSessionPool::Lease TraderSessionPool::try_acquire() {
+	//Start at a per-thread slot so threads don't all contend on the first session.
+	size_t start = hash<thread::id>()(this_thread::get_id()) % sessions.size();
+	for (size_t n = 0; n < sessions.size(); n++) {
+		size_t i = (start + n) % sessions.size();
+		if (!busy[i].load(memory_order_relaxed) && !busy[i].exchange(true, memory_order_acquire))
+			return Lease(this, i);
+	}
+	return Lease();
+}
+
+TraderSessionPool::Lease TraderSessionPool::acquire() {
+	for (;;) {
+		Lease lease = try_acquire();
+		if (lease)
+			return lease;
+		this_thread::yield();
+	}
+}
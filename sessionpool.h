@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "robinhoodtrader.h"
+
+/* TraderSessionPool: N independent RobinhoodTrader sessions (each with its own curl handle &
+   request engines) sharing one login, one instrument cache & one DNS/TLS session cache.
+   Only the first session runs a token refresher & position ledger; the others are followers
+   (see RobinhoodTrader::set_follower()) that it pushes every refreshed token to.
+   Worker threads lease a session with acquire(); leasing is lock-free (one atomic flag per
+   session), so quote & order throughput scales with the number of sessions.
+*/
+class TraderSessionPool {
+public:
+	//Lease: exclusive use of one session until destroyed.
+	class Lease {
+	public:
+		Lease() : pool(nullptr), index(0) {}
+		Lease(Lease &&other) : pool(other.pool), index(other.index) { other.pool = nullptr; }
+		Lease &operator=(Lease &&other);
+		~Lease() { release(); }
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		RobinhoodTrader &operator*() const { return *pool->sessions[index]; }
+		RobinhoodTrader *operator->() const { return pool->sessions[index].get(); }
+		explicit operator bool() const { return pool != nullptr; }
+		void release();
+
+	private:
+		friend class TraderSessionPool;
+		Lease(TraderSessionPool *pool, std::size_t index) : pool(pool), index(index) {}
+
+		TraderSessionPool *pool;
+		std::size_t index;
+	};
+
+	explicit TraderSessionPool(std::size_t size, const TransportProfile &profile = TransportProfile());
+
+	TraderSessionPool(const TraderSessionPool &) = delete;
+	TraderSessionPool &operator=(const TraderSessionPool &) = delete;
+
+	//login(): Log in once & hand the session to every pooled trader, again after each token refresh.
+	int login(const std::string &username, const std::string &password, const std::string &qr_code);
+	//share_session(): Re-distribute the first session's token, e.g. after it was refreshed.
+	void share_session();
+
+	//acquire(): Lease a free session, spinning (with yield) while all are busy.
+	Lease acquire();
+	//try_acquire(): Lease a free session; returns an empty lease if all are busy.
+	Lease try_acquire();
+
+	std::size_t size() const { return sessions.size(); }
+
+private:
+	std::vector<std::unique_ptr<RobinhoodTrader>> sessions;
+	std::unique_ptr<std::atomic<bool>[]> busy;
+};
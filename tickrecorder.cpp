@@ -0,0 +1,367 @@
+/* tickrecorder.cpp: memory mapped, day partitioned quote recording */
+
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+#include "tickrecorder.h"
+#include "exceptions.h"
+
+using namespace std;
+
+static const char tickMagic[8] = { 'R', 'H', 'T', 'I', 'C', 'K', '0', '1' };
+static const uint32_t tickVersion = 1;
+static const size_t symbolEntrySize = 16;
+
+static string os_error(const string &what) {
+#ifdef _WIN32
+	return what + " (error " + to_string(GetLastError()) + ")";
+#else
+	return what + " (" + strerror(errno) + ")";
+#endif
+}
+
+MappedFile::MappedFile()
+	: opened(false), writable(false), base(nullptr), length(0) {
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+void MappedFile::open(const string &path, bool writable) {
+	close();
+	this->path = path;
+	this->writable = writable;
+
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+						FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+						FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw RobinhoodException(os_error("MappedFile::open(): Couldn't open " + path));
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	fd = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+	if (fd < 0)
+		throw RobinhoodException(os_error("MappedFile::open(): Couldn't open " + path));
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		fd = -1;
+		throw RobinhoodException(os_error("MappedFile::open(): Couldn't stat " + path));
+	}
+	length = static_cast<size_t>(st.st_size);
+#endif
+	opened = true;
+	map();
+}
+
+void MappedFile::map() {
+	base = nullptr;
+	if (length == 0)
+		return;    //empty files can't be mapped
+#ifdef _WIN32
+	LARGE_INTEGER mapSize;
+	mapSize.QuadPart = static_cast<LONGLONG>(length);
+	mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, mapSize.HighPart, mapSize.LowPart, nullptr);
+	if (!mapping)
+		throw RobinhoodException(os_error("MappedFile: Couldn't map " + path));
+	base = static_cast<char *>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length));
+	if (!base) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+		throw RobinhoodException(os_error("MappedFile: Couldn't map " + path));
+	}
+#else
+	void *address = mmap(nullptr, length, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED)
+		throw RobinhoodException(os_error("MappedFile: Couldn't map " + path));
+	base = static_cast<char *>(address);
+#endif
+}
+
+void MappedFile::unmap() {
+	if (!base)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+	CloseHandle(mapping);
+	mapping = nullptr;
+#else
+	munmap(base, length);
+#endif
+	base = nullptr;
+}
+
+void MappedFile::resize(size_t bytes) {
+	if (!opened || !writable)
+		throw RobinhoodException("MappedFile::resize(): " + path + " is not open for writing");
+	unmap();
+#ifdef _WIN32
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(bytes);
+	if (!SetFilePointerEx(file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+		throw RobinhoodException(os_error("MappedFile::resize(): Couldn't resize " + path));
+#else
+	if (ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+		throw RobinhoodException(os_error("MappedFile::resize(): Couldn't resize " + path));
+#endif
+	length = bytes;
+	map();
+}
+
+void MappedFile::flush() {
+	if (!base || !writable)
+		return;
+#ifdef _WIN32
+	FlushViewOfFile(base, 0);
+#else
+	msync(base, length, MS_ASYNC);
+#endif
+}
+
+void MappedFile::close() {
+	if (!opened)
+		return;
+	unmap();
+#ifdef _WIN32
+	CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+#else
+	::close(fd);
+	fd = -1;
+#endif
+	opened = false;
+	length = 0;
+}
+
+static int64_t now_micros() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static size_t data_offset(uint32_t symbolCapacity) {
+	size_t offset = sizeof(TickFileHeader) + size_t(symbolCapacity) * symbolEntrySize;
+	return (offset + 63) & ~size_t(63);
+}
+
+TickRecorder::TickRecorder(const string &directory, uint32_t symbolCapacity, size_t growBytes)
+	: directory(directory), symbolCapacity(symbolCapacity), growBytes(growBytes), day(0) {
+	if (symbolCapacity == 0)
+		throw RobinhoodException("TickRecorder(): symbolCapacity must be positive");
+	if (this->growBytes < 64 * sizeof(TickRecord))
+		this->growBytes = 64 * sizeof(TickRecord);
+}
+
+TickRecorder::~TickRecorder() {
+	try {
+		close();
+	}
+	catch (...) {
+	}
+}
+
+int32_t TickRecorder::utc_day(int64_t timestamp) {
+	time_t seconds = static_cast<time_t>(timestamp / 1000000);
+	struct tm parts;
+#ifdef _WIN32
+	gmtime_s(&parts, &seconds);
+#else
+	gmtime_r(&seconds, &parts);
+#endif
+	return (parts.tm_year + 1900) * 10000 + (parts.tm_mon + 1) * 100 + parts.tm_mday;
+}
+
+string TickRecorder::file_name(int32_t day) {
+	return "ticks-" + to_string(day) + ".rht";
+}
+
+void TickRecorder::record(const Quote &quote) {
+	record(quote, now_micros());
+}
+
+void TickRecorder::record(const Quote &quote, int64_t timestamp) {
+	lock_guard<mutex> lock(recorder_mutex);
+	append(quote, timestamp);
+}
+
+void TickRecorder::record(const vector<Quote> &quotes) {
+	int64_t timestamp = now_micros();
+	lock_guard<mutex> lock(recorder_mutex);
+	for (const Quote &quote : quotes)
+		append(quote, timestamp);
+}
+
+//append(): Caller holds recorder_mutex.
+void TickRecorder::append(const Quote &quote, int64_t timestamp) {
+	if (quote.symbol == 0)
+		return;
+	int32_t recordDay = utc_day(timestamp);
+	if (!file.is_open() || recordDay != day)
+		open_day(recordDay);
+
+	TickRecord record;
+	record.timestamp = timestamp;
+	record.symbol = symbol_index(quote.symbol);
+	record.bid_size = quote.bid_size;
+	record.ask_size = quote.ask_size;
+	record.flags = quote.trading_halted ? 1 : 0;
+	record.bid_price = quote.bid_price;
+	record.ask_price = quote.ask_price;
+	record.last_trade_price = quote.last_trade_price;
+
+	uint64_t count = header()->record_count;
+	size_t offset = static_cast<size_t>(header()->data_offset + count * sizeof(TickRecord));
+	if (offset + sizeof(TickRecord) > file.size())
+		file.resize(file.size() + growBytes);
+
+	memcpy(file.data() + offset, &record, sizeof(TickRecord));
+	//Publish the record only once it is complete.
+	header()->record_count = count + 1;
+}
+
+//symbol_index(): Dictionary index of symbol in the current file, adding it if new.
+uint32_t TickRecorder::symbol_index(SymbolId symbol) {
+	auto it = indexes.find(symbol);
+	if (it != indexes.end())
+		return it->second;
+
+	TickFileHeader *h = header();
+	if (h->symbol_count >= h->symbol_capacity)
+		throw RobinhoodException("TickRecorder: symbol dictionary of " + path + " is full (" + to_string(h->symbol_capacity) + ")");
+
+	const string &name = SymbolTable::instance().name(symbol);
+	char *entry = file.data() + sizeof(TickFileHeader) + size_t(h->symbol_count) * symbolEntrySize;
+	memset(entry, 0, symbolEntrySize);
+	memcpy(entry, name.data(), std::min(name.size(), symbolEntrySize - 1));
+
+	uint32_t index = h->symbol_count++;
+	indexes.emplace(symbol, index);
+	return index;
+}
+
+void TickRecorder::open_day(int32_t newDay) {
+	close_file();
+
+	path = directory.empty() ? file_name(newDay) : directory + "/" + file_name(newDay);
+	file.open(path, true);
+	day = newDay;
+
+	if (file.size() == 0) {
+		size_t offset = data_offset(symbolCapacity);
+		file.resize(offset + growBytes);
+		TickFileHeader *h = header();
+		memset(h, 0, offset);
+		memcpy(h->magic, tickMagic, sizeof(tickMagic));
+		h->version = tickVersion;
+		h->record_size = sizeof(TickRecord);
+		h->day = newDay;
+		h->symbol_capacity = symbolCapacity;
+		h->data_offset = offset;
+		return;
+	}
+
+	//Appending to an earlier recording of the same day: take over its dictionary.
+	TickFileHeader *h = header();
+	if (file.size() < sizeof(TickFileHeader) || memcmp(h->magic, tickMagic, sizeof(tickMagic)) != 0 ||
+		h->version != tickVersion || h->record_size != sizeof(TickRecord) ||
+		file.size() < h->data_offset + h->record_count * sizeof(TickRecord)) {
+		file.close();
+		throw RobinhoodException("TickRecorder: " + path + " is not a valid tick file");
+	}
+	for (uint32_t i = 0; i < h->symbol_count; i++) {
+		const char *entry = file.data() + sizeof(TickFileHeader) + size_t(i) * symbolEntrySize;
+		indexes.emplace(SymbolTable::instance().intern(entry, strnlen(entry, symbolEntrySize)), i);
+	}
+}
+
+//close_file(): Trim the unused tail & close. Caller holds recorder_mutex.
+void TickRecorder::close_file() {
+	indexes.clear();
+	if (!file.is_open())
+		return;
+	if (file.size() >= sizeof(TickFileHeader)) {
+		size_t used = static_cast<size_t>(header()->data_offset + header()->record_count * sizeof(TickRecord));
+		file.resize(used);
+	}
+	file.close();
+}
+
+void TickRecorder::flush() {
+	lock_guard<mutex> lock(recorder_mutex);
+	file.flush();
+}
+
+void TickRecorder::close() {
+	lock_guard<mutex> lock(recorder_mutex);
+	close_file();
+}
+
+string TickRecorder::current_path() const {
+	lock_guard<mutex> lock(recorder_mutex);
+	return file.is_open() ? path : "";
+}
+
+uint64_t TickRecorder::record_count() const {
+	lock_guard<mutex> lock(recorder_mutex);
+	return file.is_open() ? header()->record_count : 0;
+}
+
+TickReader::TickReader(const string &path)
+	: records(nullptr) {
+	file.open(path, false);
+	if (file.size() < sizeof(TickFileHeader) || memcmp(header().magic, tickMagic, sizeof(tickMagic)) != 0)
+		throw RobinhoodException("TickReader(): " + path + " is not a tick file");
+	const TickFileHeader &h = header();
+	if (h.version != tickVersion || h.record_size != sizeof(TickRecord))
+		throw RobinhoodException("TickReader(): unsupported tick file version in " + path);
+	if (h.symbol_count > h.symbol_capacity ||
+		h.data_offset < sizeof(TickFileHeader) + size_t(h.symbol_capacity) * symbolEntrySize ||
+		file.size() < h.data_offset + h.record_count * sizeof(TickRecord))
+		throw RobinhoodException("TickReader(): " + path + " is truncated");
+
+	records = reinterpret_cast<const TickRecord *>(file.data() + h.data_offset);
+	symbols.reserve(h.symbol_count);
+	for (uint32_t i = 0; i < h.symbol_count; i++) {
+		const char *name = symbol_name(i);
+		symbols.push_back(SymbolTable::instance().intern(name, strnlen(name, symbolEntrySize)));
+	}
+}
+
+const char *TickReader::symbol_name(uint32_t index) const {
+	if (index >= header().symbol_count)
+		return "";
+	return file.data() + sizeof(TickFileHeader) + size_t(index) * symbolEntrySize;
+}
+
+Quote TickReader::quote(const TickRecord &record) const {
+	Quote quote = {};
+	quote.symbol = symbol_id(record.symbol);
+	quote.bid_size = record.bid_size;
+	quote.ask_size = record.ask_size;
+	quote.trading_halted = record.flags & 1;
+	quote.bid_price = record.bid_price;
+	quote.ask_price = record.ask_price;
+	quote.last_trade_price = record.last_trade_price;
+	quote.updated_at = record.timestamp;
+	return quote;
+}
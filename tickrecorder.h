@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include "records.h"
+
+/* Tick files: one per UTC day, "ticks-YYYYMMDD.rht" in the recorder's directory.
+     TickFileHeader (64 bytes)
+     symbol dictionary: symbol_capacity entries of 16 bytes (NUL terminated ticker)
+     TickRecord array from data_offset, record_count entries of 48 bytes
+   All integers are little endian as written by the host.  Records refer to symbols by their
+   dictionary index, so files don't depend on the SymbolIds of the process that wrote them.
+*/
+struct TickFileHeader {
+	char magic[8];               //"RHTICK01"
+	uint32_t version;
+	uint32_t record_size;
+	int32_t day;                 //YYYYMMDD
+	uint32_t symbol_capacity;
+	uint32_t symbol_count;
+	uint32_t reserved;
+	uint64_t record_count;
+	uint64_t data_offset;
+	char padding[16];
+};
+
+struct TickRecord {
+	int64_t timestamp;           //microseconds since epoch, when the quote was recorded
+	uint32_t symbol;             //index into the file's symbol dictionary
+	uint32_t bid_size;
+	uint32_t ask_size;
+	uint32_t flags;              //bit 0: trading halted
+	Price bid_price;
+	Price ask_price;
+	Price last_trade_price;
+};
+
+static_assert(sizeof(TickFileHeader) == 64, "tick file header layout");
+static_assert(sizeof(TickRecord) == 48, "tick record layout");
+
+//MappedFile: a file mapped into memory, read-only or read-write & resizable. POSIX & Windows.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	//open(): Map the whole file; writable creates it if missing. Throws RobinhoodException.
+	void open(const std::string &path, bool writable);
+	//resize(): Grow or truncate a writable file & remap it. Pointers into the old mapping become invalid.
+	void resize(std::size_t bytes);
+	//flush(): Schedule the dirty pages for writing.
+	void flush();
+	void close();
+
+	bool is_open() const { return opened; }
+	char *data() const { return base; }
+	std::size_t size() const { return length; }
+
+private:
+	void map();
+	void unmap();
+
+	std::string path;
+	bool opened;
+	bool writable;
+	char *base;
+	std::size_t length;
+#ifdef _WIN32
+	void *file;                  //HANDLE
+	void *mapping;               //HANDLE
+#else
+	int fd;
+#endif
+};
+
+/* TickRecorder: appends quotes to memory mapped, day partitioned tick files.  Files grow in
+   large steps so recording is a memcpy into the mapping; close() trims the unused tail.  An
+   existing file for the day is appended to.  Thread safe.
+*/
+class TickRecorder {
+public:
+	explicit TickRecorder(const std::string &directory, uint32_t symbolCapacity = 8192, std::size_t growBytes = 16 << 20);
+	~TickRecorder();
+	TickRecorder(const TickRecorder &) = delete;
+	TickRecorder &operator=(const TickRecorder &) = delete;
+
+	//record(): Append quote stamped with the current time, or with timestamp (microseconds since epoch).
+	void record(const Quote &quote);
+	void record(const Quote &quote, int64_t timestamp);
+	void record(const std::vector<Quote> &quotes);
+
+	void flush();
+	//close(): Trim & close the current file. The next record() reopens.
+	void close();
+
+	std::string current_path() const;
+	uint64_t record_count() const;
+
+	static std::string file_name(int32_t day);
+	//utc_day(): YYYYMMDD of a timestamp in microseconds since epoch.
+	static int32_t utc_day(int64_t timestamp);
+
+private:
+	void append(const Quote &quote, int64_t timestamp);
+	void open_day(int32_t day);
+	void close_file();
+	uint32_t symbol_index(SymbolId symbol);
+	TickFileHeader *header() const { return reinterpret_cast<TickFileHeader *>(file.data()); }
+
+	std::string directory;
+	uint32_t symbolCapacity;
+	std::size_t growBytes;
+
+	mutable std::mutex recorder_mutex;
+	MappedFile file;
+	std::string path;
+	int32_t day;
+	std::unordered_map<SymbolId, uint32_t> indexes;    //process SymbolId -> dictionary index
+};
+
+/* TickReader: read-only view of a tick file.  Records are read straight from the mapping
+   without copying; they stay valid while the reader lives.
+*/
+class TickReader {
+public:
+	explicit TickReader(const std::string &path);
+
+	int32_t day() const { return header().day; }
+	std::size_t size() const { return static_cast<std::size_t>(header().record_count); }
+	const TickRecord *begin() const { return records; }
+	const TickRecord *end() const { return records + size(); }
+	const TickRecord &operator[](std::size_t i) const { return records[i]; }
+
+	uint32_t symbol_count() const { return header().symbol_count; }
+	const char *symbol_name(uint32_t index) const;
+	//symbol_id(): Dictionary index interned into this process's SymbolTable.
+	SymbolId symbol_id(uint32_t index) const { return index < symbols.size() ? symbols[index] : 0; }
+	//quote(): Record as a Quote (instrument & previous close aren't recorded).
+	Quote quote(const TickRecord &record) const;
+
+private:
+	const TickFileHeader &header() const { return *reinterpret_cast<const TickFileHeader *>(file.data()); }
+
+	MappedFile file;
+	const TickRecord *records;
+	std::vector<SymbolId> symbols;
+};
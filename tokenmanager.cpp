@@ -0,0 +1,346 @@
+/* tokenmanager.cpp: encrypted session persistence & background OAuth token refresh */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "tokenmanager.h"
+#include "exceptions.h"
+#include "logger.h"
+
+extern "C" {
+#include "authentication/hmac.h"
+#include "authentication/sha1.h"
+}
+
+using namespace std;
+using json = nlohmann::json;
+
+static const char sessionMagic[8] = { 'R', 'H', 'S', 'E', 'S', 'S', '0', '1' };
+static const size_t saltSize = 16;
+static const int kdfIterations = 10000;
+
+chrono::microseconds OAuthSession::expires_in() const {
+	if (expires_at == 0)
+		return chrono::microseconds::max();
+	int64_t now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	return chrono::microseconds(expires_at > now ? expires_at - now : 0);
+}
+
+static void hmac(const vector<uint8_t> &key, const uint8_t *data, size_t len, uint8_t *digest) {
+	hmac_sha1(key.data(), int(key.size()), data, int(len), digest, SHA1_DIGEST_LENGTH);
+}
+
+static void put_be32(vector<uint8_t> &out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(uint8_t(value >> shift));
+}
+
+//derive_keys(): PBKDF2-HMAC-SHA1 (RFC 2898) of passphrase & salt, split into encryption & MAC keys.
+static void derive_keys(const string &passphrase, const uint8_t *salt, vector<uint8_t> &encryptKey, vector<uint8_t> &macKey) {
+	vector<uint8_t> password(passphrase.begin(), passphrase.end());
+	uint8_t blocks[2][SHA1_DIGEST_LENGTH];
+	for (uint32_t block = 1; block <= 2; block++) {
+		vector<uint8_t> first(salt, salt + saltSize);
+		put_be32(first, block);
+		uint8_t u[SHA1_DIGEST_LENGTH];
+		hmac(password, first.data(), first.size(), u);
+		uint8_t *t = blocks[block - 1];
+		memcpy(t, u, SHA1_DIGEST_LENGTH);
+		for (int i = 1; i < kdfIterations; i++) {
+			uint8_t previous[SHA1_DIGEST_LENGTH];
+			memcpy(previous, u, SHA1_DIGEST_LENGTH);
+			hmac(password, previous, SHA1_DIGEST_LENGTH, u);
+			for (int j = 0; j < SHA1_DIGEST_LENGTH; j++)
+				t[j] ^= u[j];
+		}
+	}
+	encryptKey.assign(blocks[0], blocks[0] + SHA1_DIGEST_LENGTH);
+	macKey.assign(blocks[1], blocks[1] + SHA1_DIGEST_LENGTH);
+}
+
+//apply_keystream(): XOR data with HMAC(key, salt || counter) blocks. Encrypts & decrypts.
+static void apply_keystream(const vector<uint8_t> &key, const uint8_t *salt, uint8_t *data, size_t len) {
+	uint8_t stream[SHA1_DIGEST_LENGTH];
+	for (size_t offset = 0, counter = 0; offset < len; offset += SHA1_DIGEST_LENGTH, counter++) {
+		vector<uint8_t> input(salt, salt + saltSize);
+		put_be32(input, uint32_t(counter));
+		hmac(key, input.data(), input.size(), stream);
+		for (size_t i = 0; i < SHA1_DIGEST_LENGTH && offset + i < len; i++)
+			data[offset + i] ^= stream[i];
+	}
+}
+
+void SessionFile::save(const string &path, const OAuthSession &session, const string &passphrase) {
+	json document = { { "access_token", session.access_token }, { "refresh_token", session.refresh_token },
+					  { "device_token", session.device_token }, { "expires_at", session.expires_at } };
+	string plain = document.dump();
+
+	vector<uint8_t> file(sessionMagic, sessionMagic + sizeof(sessionMagic));
+	random_device random;
+	for (size_t i = 0; i < saltSize; i++)
+		file.push_back(uint8_t(random()));
+	const size_t saltOffset = sizeof(sessionMagic);
+	file.insert(file.end(), plain.begin(), plain.end());
+
+	vector<uint8_t> encryptKey, macKey;
+	derive_keys(passphrase, file.data() + saltOffset, encryptKey, macKey);
+	apply_keystream(encryptKey, file.data() + saltOffset, file.data() + saltOffset + saltSize, plain.size());
+
+	uint8_t mac[SHA1_DIGEST_LENGTH];
+	hmac(macKey, file.data(), file.size(), mac);
+	file.insert(file.end(), mac, mac + SHA1_DIGEST_LENGTH);
+
+	string temporary = path + ".tmp";
+	{
+		ofstream out(temporary, ios::binary | ios::trunc);
+		if (!out)
+			throw RobinhoodException("SessionFile::save(): Could not open " + temporary);
+#ifndef _WIN32
+		chmod(temporary.c_str(), S_IRUSR | S_IWUSR);
+#endif
+		out.write(reinterpret_cast<const char *>(file.data()), file.size());
+		if (!out)
+			throw RobinhoodException("SessionFile::save(): Could not write " + temporary);
+	}
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(path.c_str());
+		if (rename(temporary.c_str(), path.c_str()) != 0)
+			throw RobinhoodException("SessionFile::save(): Could not replace " + path);
+	}
+}
+
+bool SessionFile::load(const string &path, const string &passphrase, OAuthSession &session) {
+	ifstream in(path, ios::binary);
+	if (!in)
+		return false;
+	vector<uint8_t> file((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+	const size_t saltOffset = sizeof(sessionMagic);
+	if (file.size() < saltOffset + saltSize + SHA1_DIGEST_LENGTH || memcmp(file.data(), sessionMagic, sizeof(sessionMagic)) != 0)
+		throw RobinhoodException("SessionFile::load(): " + path + " is not a session file");
+
+	vector<uint8_t> encryptKey, macKey;
+	derive_keys(passphrase, file.data() + saltOffset, encryptKey, macKey);
+
+	size_t macOffset = file.size() - SHA1_DIGEST_LENGTH;
+	uint8_t mac[SHA1_DIGEST_LENGTH];
+	hmac(macKey, file.data(), macOffset, mac);
+	uint8_t difference = 0;
+	for (size_t i = 0; i < SHA1_DIGEST_LENGTH; i++)
+		difference |= uint8_t(mac[i] ^ file[macOffset + i]);
+	if (difference)
+		throw RobinhoodException("SessionFile::load(): Wrong passphrase or damaged file " + path);
+
+	size_t plainOffset = saltOffset + saltSize;
+	apply_keystream(encryptKey, file.data() + saltOffset, file.data() + plainOffset, macOffset - plainOffset);
+	try {
+		json document = json::parse(file.begin() + plainOffset, file.begin() + macOffset);
+		session.access_token = document.value("access_token", "");
+		session.refresh_token = document.value("refresh_token", "");
+		session.device_token = document.value("device_token", "");
+		session.expires_at = document.value("expires_at", int64_t(0));
+	}
+	catch (const json::exception &e) {
+		throw RobinhoodException("SessionFile::load(): Malformed session in " + path + ": " + e.what());
+	}
+	return true;
+}
+
+TokenManager::TokenManager(Refresh refresh, Install install)
+	: refresh(refresh), install(install), margin(300), retry_delay(0), generation(0),
+	  refresh_count(0), failure_count(0), stopping(false) {
+}
+
+TokenManager::~TokenManager() {
+	stop();
+}
+
+OAuthSession TokenManager::session() const {
+	lock_guard<mutex> lock(session_mutex);
+	return current;
+}
+
+void TokenManager::set_session(const OAuthSession &session) {
+	adopt(session);
+	start();
+}
+
+//adopt(): Make session current, save it (if persist) & reschedule the refresh.
+void TokenManager::adopt(const OAuthSession &session, bool persist) {
+	string path, passphrase;
+	{
+		lock_guard<mutex> lock(session_mutex);
+		current = session;
+		retry_delay = chrono::seconds(0);
+		generation++;
+		path = file_path;
+		passphrase = file_passphrase;
+	}
+	changed.notify_all();
+
+	if (persist && !path.empty() && session.valid()) {
+		try {
+			SessionFile::save(path, session, passphrase);
+		}
+		catch (const RobinhoodException &e) {
+			RH_LOG(LOG_WARNING, "TokenManager: {}", e.what());
+		}
+	}
+}
+
+void TokenManager::persist_to(const string &path, const string &passphrase) {
+	OAuthSession saved;
+	{
+		lock_guard<mutex> lock(session_mutex);
+		file_path = path;
+		file_passphrase = passphrase;
+		saved = current;
+	}
+	if (saved.valid())
+		SessionFile::save(path, saved, passphrase);
+}
+
+bool TokenManager::restore(const string &path, const string &passphrase) {
+	OAuthSession saved;
+	if (!SessionFile::load(path, passphrase, saved) || !saved.valid())
+		return false;
+	{
+		lock_guard<mutex> lock(session_mutex);
+		file_path = path;
+		file_passphrase = passphrase;
+		current = saved;
+	}
+
+	if (saved.expires_in().count() == 0) {
+		RH_LOG(LOG_INFO, "TokenManager: saved access token expired, refreshing");
+		try {
+			refresh_now();
+		}
+		catch (const exception &e) {
+			RH_LOG(LOG_WARNING, "TokenManager: could not refresh the saved session: {}", e.what());
+			lock_guard<mutex> lock(session_mutex);
+			current = OAuthSession();
+			return false;
+		}
+	}
+	else {
+		install(saved);
+		adopt(saved, false);
+	}
+	start();
+	return true;
+}
+
+void TokenManager::refresh_now() {
+	lock_guard<mutex> serial(refresh_mutex);
+	OAuthSession old = session();
+	if (old.refresh_token.empty())
+		throw RobinhoodException("TokenManager::refresh_now(): No refresh token");
+
+	OAuthSession fresh = refresh(old);
+	if (!fresh.valid())
+		throw RobinhoodException("TokenManager::refresh_now(): Refresh returned no access token");
+	if (fresh.refresh_token.empty())
+		fresh.refresh_token = old.refresh_token;
+	if (fresh.device_token.empty())
+		fresh.device_token = old.device_token;
+
+	install(fresh);
+	adopt(fresh);
+	refresh_count.fetch_add(1, memory_order_relaxed);
+	RH_LOG(LOG_INFO, "TokenManager: access token refreshed");
+
+	Install notify;
+	{
+		lock_guard<mutex> lock(session_mutex);
+		notify = listener;
+	}
+	if (notify)
+		notify(fresh);
+}
+
+void TokenManager::set_margin(chrono::seconds margin) {
+	{
+		lock_guard<mutex> lock(session_mutex);
+		this->margin = margin;
+		generation++;
+	}
+	changed.notify_all();
+}
+
+void TokenManager::set_listener(Install listener) {
+	lock_guard<mutex> lock(session_mutex);
+	this->listener = listener;
+}
+
+void TokenManager::start() {
+	lock_guard<mutex> lock(session_mutex);
+	if (refresher.joinable())
+		return;
+	stopping = false;
+	refresher = thread(&TokenManager::run, this);
+}
+
+void TokenManager::stop() {
+	{
+		lock_guard<mutex> lock(session_mutex);
+		if (!refresher.joinable())
+			return;
+		stopping = true;
+	}
+	changed.notify_all();
+	refresher.join();
+	refresher = thread();
+}
+
+bool TokenManager::running() const {
+	lock_guard<mutex> lock(session_mutex);
+	return refresher.joinable() && !stopping;
+}
+
+//next_refresh(): Caller holds session_mutex.
+chrono::system_clock::time_point TokenManager::next_refresh() const {
+	auto now = chrono::system_clock::now();
+	if (retry_delay.count())
+		return now + retry_delay;
+	chrono::microseconds remaining = current.expires_in();
+	chrono::microseconds lead = min<chrono::microseconds>(margin, remaining / 2);
+	return now + (remaining - lead);
+}
+
+//run(): Refresher thread. Sleeps until the next refresh is due or the session changes.
+void TokenManager::run() {
+	unique_lock<mutex> lock(session_mutex);
+	while (!stopping) {
+		if (!current.valid() || current.refresh_token.empty() || current.expires_at == 0) {
+			uint64_t seen = generation;
+			changed.wait(lock, [&] { return stopping || generation != seen; });
+			continue;
+		}
+		uint64_t seen = generation;
+		if (changed.wait_until(lock, next_refresh(), [&] { return stopping || generation != seen; }))
+			continue;
+
+		lock.unlock();
+		bool failed = false;
+		try {
+			refresh_now();
+		}
+		catch (const exception &e) {
+			failure_count.fetch_add(1, memory_order_relaxed);
+			RH_LOG(LOG_WARNING, "TokenManager: token refresh failed: {}", e.what());
+			failed = true;
+		}
+		lock.lock();
+		if (failed)
+			retry_delay = min(max(retry_delay * 2, chrono::seconds(5)), chrono::seconds(60));
+	}
+}
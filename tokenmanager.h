@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+//OAuthSession: tokens of a login. expires_at is in microseconds since epoch, 0 if unknown.
+struct OAuthSession {
+	std::string access_token;
+	std::string refresh_token;
+	std::string device_token;
+	int64_t expires_at = 0;
+
+	bool valid() const { return !access_token.empty(); }
+	//expires_in(): Time left on the access token; zero once expired, max() if unknown.
+	std::chrono::microseconds expires_in() const;
+};
+
+/* SessionFile: an OAuthSession sealed into a local file with a passphrase.  Keys are derived
+   with PBKDF2-HMAC-SHA1 over a random per-file salt; the tokens are XORed with an HMAC-SHA1
+   counter keystream & the whole file is authenticated with HMAC-SHA1 (encrypt then MAC).
+   Files are replaced atomically & are readable by the owner only (POSIX).
+*/
+class SessionFile {
+public:
+	//save(): Throws RobinhoodException if the file can't be written.
+	static void save(const std::string &path, const OAuthSession &session, const std::string &passphrase);
+	//load(): Returns false if there is no file. Throws RobinhoodException if it is corrupt,
+	//was tampered with or the passphrase is wrong.
+	static bool load(const std::string &path, const std::string &passphrase, OAuthSession &session);
+};
+
+/* TokenManager: keeps a session's access token fresh.  A background thread exchanges the
+   refresh token for a new access token some time before the current one expires & hands it
+   to install, which switches the trader's headers for requests started from then on; those
+   already in flight finish with the old token.  Failed refreshes are retried with backoff
+   (5s doubling up to a minute).  Every new session is written to the session file, if set.
+*/
+class TokenManager {
+public:
+	//Refresh: exchange refresh_token for a new session. Throws on failure.
+	typedef std::function<OAuthSession(const OAuthSession &current)> Refresh;
+	typedef std::function<void(const OAuthSession &session)> Install;
+
+	TokenManager(Refresh refresh, Install install);
+	~TokenManager();
+
+	TokenManager(const TokenManager &) = delete;
+	TokenManager &operator=(const TokenManager &) = delete;
+
+	//set_session(): Adopt a session obtained by a login; it is installed by the caller.
+	void set_session(const OAuthSession &session);
+	OAuthSession session() const;
+
+	//persist_to(): Save the session to path now (if there is one) & after every refresh.
+	void persist_to(const std::string &path, const std::string &passphrase);
+	//restore(): Load the session saved at path, refreshing it first if its access token expired.
+	//Returns false if there is no usable session there; the caller logs in instead.
+	bool restore(const std::string &path, const std::string &passphrase);
+
+	//Background refresh, started by default once there is a session.
+	void start();
+	void stop();
+	bool running() const;
+	//refresh_now(): Refresh on the calling thread. Throws on failure.
+	void refresh_now();
+
+	//set_margin(): Refresh this long before expiry (default 5 minutes), or at half the
+	//token's remaining lifetime if that is shorter.
+	void set_margin(std::chrono::seconds margin);
+	//set_listener(): Called on the refreshing thread after each new session was installed.
+	void set_listener(Install listener);
+
+	uint64_t refreshes() const { return refresh_count.load(std::memory_order_relaxed); }
+	uint64_t failures() const { return failure_count.load(std::memory_order_relaxed); }
+
+private:
+	void run();
+	void adopt(const OAuthSession &session, bool persist = true);
+	std::chrono::system_clock::time_point next_refresh() const;
+
+	Refresh refresh;
+	Install install;
+	Install listener;
+	mutable std::mutex session_mutex;
+	std::condition_variable changed;
+	OAuthSession current;
+	std::string file_path;
+	std::string file_passphrase;
+	std::chrono::seconds margin;
+	std::chrono::seconds retry_delay;      //backoff after a failed refresh, 0 when the last one succeeded
+	uint64_t generation;                   //bumped whenever the refresh schedule changes
+	std::mutex refresh_mutex;              //one refresh at a time
+	std::atomic<uint64_t> refresh_count;
+	std::atomic<uint64_t> failure_count;
+	bool stopping;
+	std::thread refresher;
+};
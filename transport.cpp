@@ -0,0 +1,87 @@
+/* transport.cpp: connection settings shared by all curl handles */
+
+#include "transport.h"
+#include "endpoints.h"
+#include "exceptions.h"
+
+using namespace std;
+
+SharedTransport::SharedTransport() {
+	share = curl_share_init();
+	if (!share)
+		throw RobinhoodException("SharedTransport(): Could not initialize curl share handle");
+
+	curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock);
+	curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock);
+	curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	//No CURL_LOCK_DATA_CONNECT: libcurl can't share a connection cache between handles that run
+	//transfers on different threads at once, so every easy & multi handle keeps its own pool.
+}
+
+SharedTransport::~SharedTransport() {
+	curl_share_cleanup(share);
+}
+
+void SharedTransport::lock(CURL *, curl_lock_data data, curl_lock_access, void *self) {
+	static_cast<SharedTransport *>(self)->locks[data].lock();
+}
+
+void SharedTransport::unlock(CURL *, curl_lock_data data, void *self) {
+	static_cast<SharedTransport *>(self)->locks[data].unlock();
+}
+
+HeaderList make_header_list(curl_slist *list) {
+	return HeaderList(list, curl_slist_free_all);
+}
+
+string route_url(const string &url, const TransportProfile &profile) {
+	if (profile.base_url.empty() || url.compare(0, api_url.size(), api_url) != 0)
+		return url;
+	return profile.base_url + url.substr(api_url.size());
+}
+
+void configure_handle(CURL *curl, curl_slist *headers, const TransportProfile &profile, CURLSH *share) {
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+	// Don't bother trying IPv6, which would increase DNS resolution time.
+	if (profile.ipv4_only)
+		curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+
+	// Don't wait forever.
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, profile.timeout_seconds);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, profile.connect_timeout_ms);
+
+	// Follow HTTP redirects if necessary.
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+	//libcurl picks the one the server supports.
+	curl_easy_setopt(curl, CURLOPT_HTTPAUTH, (long)CURLAUTH_ANY);
+
+	//Accept-Encoding and automatic decompressing data.
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+
+	//Small requests: send them right away & keep idle connections alive.
+	curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, profile.tcp_nodelay ? 1L : 0L);
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, profile.tcp_keepalive ? 1L : 0L);
+	if (profile.tcp_keepalive) {
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, profile.keepalive_idle_seconds);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, profile.keepalive_interval_seconds);
+	}
+	curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, profile.dns_cache_timeout_seconds);
+
+	if (profile.http2 && (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+		curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+
+	if (share)
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+}
+
+void configure_multi(CURLM *multi, const TransportProfile &profile) {
+	//Keep a small pool of connections per host; requests beyond that wait for a free connection.
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, profile.max_host_connections);
+
+	if (profile.http2)
+		curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <curl/curl.h>
+#include <mutex>
+#include <memory>
+#include <string>
+
+/* TransportProfile: connection settings applied to every curl handle the trader uses.
+   The defaults keep connections warm & reuse DNS lookups and TLS sessions between handles.
+*/
+struct TransportProfile {
+	long timeout_seconds;             //whole request
+	long connect_timeout_ms;
+	bool tcp_nodelay;
+	bool tcp_keepalive;
+	long keepalive_idle_seconds;
+	long keepalive_interval_seconds;
+	long dns_cache_timeout_seconds;   //-1 caches forever
+	bool ipv4_only;                   //skip IPv6 resolution
+	bool http2;                       //negotiate HTTP/2 over TLS when libcurl supports it
+	bool share_handles;               //share DNS cache & TLS sessions between handles
+	long max_host_connections;        //per request engine
+	bool warm_up;                     //pre-connect all handles in the RobinhoodTrader constructor
+	std::string base_url;             //send api_url requests here instead, e.g. a MockServer's base_url(); empty: the real API
+
+	TransportProfile()
+		: timeout_seconds(15),
+		connect_timeout_ms(5000),
+		tcp_nodelay(true),
+		tcp_keepalive(true),
+		keepalive_idle_seconds(30),
+		keepalive_interval_seconds(15),
+		dns_cache_timeout_seconds(300),
+		ipv4_only(true),
+		http2(true),
+		share_handles(true),
+		max_host_connections(8),
+		warm_up(false) {}
+
+	bool redirected() const { return !base_url.empty(); }
+
+};
+
+/* SharedTransport: CURLSH holding the DNS cache & TLS session cache shared by all handles of a
+   trader, with the locking libcurl needs to share them across threads.  Connections are not
+   shared: each handle or multi handle keeps its own pool.
+*/
+class SharedTransport {
+public:
+	SharedTransport();
+	~SharedTransport();
+
+	SharedTransport(const SharedTransport &) = delete;
+	SharedTransport &operator=(const SharedTransport &) = delete;
+
+	CURLSH *handle() const { return share; }
+
+private:
+	static void lock(CURL *, curl_lock_data data, curl_lock_access, void *self);
+	static void unlock(CURL *, curl_lock_data data, void *self);
+
+	CURLSH *share;
+	std::mutex locks[CURL_LOCK_DATA_LAST];
+};
+
+//HeaderList: a curl header list, freed once the trader & every transfer using it have let go.
+typedef std::shared_ptr<curl_slist> HeaderList;
+//make_header_list(): Take ownership of list.
+HeaderList make_header_list(curl_slist *list);
+
+//configure_handle(): Apply headers & profile to an easy handle. share may be null.
+void configure_handle(CURL *curl, curl_slist *headers, const TransportProfile &profile, CURLSH *share);
+
+//route_url(): The URL a request for url is sent to under profile (api_url rewritten to base_url).
+std::string route_url(const std::string &url, const TransportProfile &profile);
+
+//configure_multi(): Apply the profile's connection limits & multiplexing to a multi handle.
+void configure_multi(CURLM *multi, const TransportProfile &profile);